@@ -17,6 +17,7 @@
 #include <linux/mm.h>
 #include <linux/module.h>
 #include <linux/poll.h>
+#include <linux/rwsem.h>
 #include <linux/semaphore.h>
 #include <linux/smp.h> /* get_cpu, put_cpu */
 #include <linux/types.h>
@@ -36,6 +37,21 @@
 #endif /* CONFIG_IRQ_DOMAIN */
 #endif /* CONFIG_PROVENCORE_DTS_CONFIGURATION */
 
+#ifdef CONFIG_PROVENCORE_REE_CMA
+#include <linux/cma.h>
+#include <linux/highmem.h>
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5,10,0)
+#include <linux/dma-map-ops.h>
+#else
+#include <linux/dma-contiguous.h>
+#endif
+#endif /* CONFIG_PROVENCORE_REE_CMA */
+
+#ifdef CONFIG_PROVENCORE_REE_DMABUF
+#include <linux/dma-buf.h>
+#include <linux/dma-mapping.h>
+#endif /* CONFIG_PROVENCORE_REE_DMABUF */
+
 #include <asm/ioctl.h>
 
 #include "internal.h"
@@ -103,6 +119,28 @@ _Static_assert((
 #define TZ_IOCTL_WAIT_SIGNAL        17
 #define TZ_IOCTL_WAIT_EVENT         18
 #define TZ_IOCTL_GET_PENDING_EVENTS 19
+#define TZ_IOCTL_SET_EVENTFD        20
+#define TZ_IOCTL_LEASE_SID          21
+#define TZ_IOCTL_ATTACH_REGION      22
+#define TZ_IOCTL_RESIZE_REGION      23
+#define TZ_IOCTL_DETACH_REGION      24
+#define TZ_IOCTL_REGISTER_BUFFER    25
+#define TZ_IOCTL_UNREGISTER_BUFFER  26
+#define TZ_IOCTL_EXPORT_DMABUF      27
+#define TZ_IOCTL_IMPORT_DMABUF      28
+
+/**
+ * mmap offset (in pages) of the session's read-only status page: any lower
+ * offset maps the session's SHM area.
+ */
+#define TZ_MMAP_STATUS_PGOFF        (1UL << 20)
+
+/**
+ * mmap offset (in pages) of the session's regions: bits above
+ * TZ_MMAP_REGION_SHIFT give the region id, lower bits the offset in region.
+ * Region 0 is the session's SHM area.
+ */
+#define TZ_MMAP_REGION_SHIFT        24
 
 /**
  * @brief Parameter vector for the \ref TZ_IOCTL_SEND_EXT_OBSOLETE request.
@@ -143,12 +181,33 @@ unsigned int _irq;
 #define VM_RESERVED   (VM_DONTEXPAND | VM_DONTDUMP)
 #endif
 
+/**
+ * @brief State of an opened trustzone device file
+ */
+struct pnc_file
+{
+    /** Session used through the file, replaced once by TZ_IOCTL_LEASE_SID */
+    pnc_session_t *session;
+    /**
+     * Held for reading by file operations using \p session, for writing
+     * while replacing it.
+     */
+    struct rw_semaphore lock;
+};
+
+/**
+ * Region mappings are counted: region can't be detached, shrunk nor moved
+ * while mapped. Mapping handle is in vma private data, whatever vma splits
+ * and whatever happens to the session meanwhile.
+ */
 static void pnc_vma_open(struct vm_area_struct *vma)
 {
+    pnc_shm_map_dup(vma->vm_private_data);
 }
 
 static void pnc_vma_close(struct vm_area_struct *vma)
 {
+    pnc_shm_map_put(vma->vm_private_data);
 }
 
 static struct vm_operations_struct pnc_mmap_vm_ops = {
@@ -156,30 +215,143 @@ static struct vm_operations_struct pnc_mmap_vm_ops = {
         .close =    pnc_vma_close,
 };
 
-static int pnc_miscdev_mmap(struct file *filp, struct vm_area_struct *vma)
+/** Status page holds its own page reference: nothing to count */
+static struct vm_operations_struct pnc_status_vm_ops = {
+};
+
+/**
+ * @brief Map session's status page, read only.
+ * @param s             User session
+ * @param vma           Single page, shared, virtual memory area
+ * @return              - 0 on success
+ *                      - an error code otherwise
+ */
+static int pnc_mmap_status(pnc_session_t *s, struct vm_area_struct *vma)
+{
+    struct page *page;
+    int r;
+
+    if ((vma->vm_end - vma->vm_start) != PAGE_SIZE) {
+        pr_err("(%s) status mapping must be a single page\n", __func__);
+        return -EINVAL;
+    }
+    if ((vma->vm_flags & VM_SHARED) == 0) {
+        pr_err("(%s) mapping must be shared\n", __func__);
+        return -EINVAL;
+    }
+    if (vma->vm_flags & VM_WRITE) {
+        pr_err("(%s) status mapping must be read only\n", __func__);
+        return -EPERM;
+    }
+
+    r = pnc_session_get_status_page(s, &page);
+    if (r != 0) {
+        return r;
+    }
+
+    vma->vm_ops = &pnc_status_vm_ops;
+    vma->vm_flags &= ~VM_MAYWRITE;
+    vma->vm_flags |= VM_RESERVED;
+
+    r = vm_insert_page(vma, vma->vm_start, page);
+    if (r != 0) {
+        pr_err("(%s) failed to insert page (%d)\n", __func__, r);
+    }
+    /* vma holds its own reference on page once inserted */
+    put_page(page);
+    return r;
+}
+
+/** Max num of pages handed to vm_insert_pages() at once */
+#define PNC_MMAP_BATCH              64
+
+/**
+ * @brief Insert a range of contiguous SHM pages in user vma.
+ * @param vma           Destination virtual memory area
+ * @param pfn           First page frame number to insert
+ * @param nr_pages      Num of pages to insert, from vma start
+ * @return              - 0 on success
+ *                      - an error code otherwise
+ */
+static int pnc_mmap_insert_pages(struct vm_area_struct *vma, unsigned long pfn,
+    unsigned long nr_pages)
+{
+    unsigned long addr = vma->vm_start;
+    int r;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5,8,0)
+    /*
+     * Batched insertion: page table lock is taken once per batch instead of
+     * once per page, which matters for multi MB regions.
+     */
+    struct page *pages[PNC_MMAP_BATCH];
+    unsigned long count, left, i;
+
+    while (nr_pages > 0) {
+        count = min_t(unsigned long, nr_pages, PNC_MMAP_BATCH);
+        for (i = 0; i < count; i++) {
+            pages[i] = pfn_to_page(pfn + i);
+        }
+        left = count;
+        r = vm_insert_pages(vma, addr, pages, &left);
+        if (r != 0) {
+            pr_err("(%s) failed to insert pages (%d)\n", __func__, r);
+            return r;
+        }
+        addr += count << PAGE_SHIFT;
+        pfn += count;
+        nr_pages -= count;
+    }
+#else
+    unsigned long i;
+
+    for (i = 0; i < nr_pages; i++, pfn++, addr += PAGE_SIZE) {
+        r = vm_insert_page(vma, addr, pfn_to_page(pfn));
+        if (r != 0) {
+            pr_err("(%s) failed to insert page (%d)\n", __func__, r);
+            return r;
+        }
+    }
+#endif
+    return 0;
+}
+
+static int pnc_miscdev_mmap_session(pnc_session_t *s,
+    struct vm_area_struct *vma)
 {
-    pnc_session_t *s = filp->private_data;
     unsigned long mem_offset, mem_nr_pages;
     unsigned long offset, nr_pages;
-    unsigned long i, pfn;
+    struct pnc_shm_map *map;
+    unsigned int region;
     int r;
 
     offset = vma->vm_pgoff;
     nr_pages = (vma->vm_end - vma->vm_start) >> PAGE_SHIFT;
 
-    if (pnc_session_get_mem_offset(s, &mem_offset, &mem_nr_pages) < 0) {
-        pr_err("(%s) no configured memory range\n", __func__);
-        return -ENODEV;
+    if (offset == TZ_MMAP_STATUS_PGOFF) {
+        return pnc_mmap_status(s, vma);
     }
 
-    pr_debug("(%s) pid=%d\n", __func__, current->pid);
-
+    region = offset >> TZ_MMAP_REGION_SHIFT;
+    offset &= (1UL << TZ_MMAP_REGION_SHIFT) - 1;
     if ((vma->vm_flags & VM_SHARED) == 0) {
         pr_err("(%s) mapping must be shared\n", __func__);
         return -EINVAL;
     }
+
+    r = pnc_session_map_region(s, region, &mem_offset, &mem_nr_pages, &map);
+    if (r == -ERESTARTSYS) {
+        return r;
+    }
+    if (r < 0) {
+        pr_err("(%s) no configured memory range\n", __func__);
+        return -ENODEV;
+    }
+
+    pr_debug("(%s) pid=%d\n", __func__, current->pid);
+
     if (offset >= mem_nr_pages || offset + nr_pages > mem_nr_pages) {
         pr_err("(%s) mapping out of bounds\n", __func__);
+        pnc_shm_map_put(map);
         return -EINVAL;
     }
 
@@ -188,29 +360,60 @@ static int pnc_miscdev_mmap(struct file *filp, struct vm_area_struct *vma)
         (mem_offset + offset + nr_pages) << PAGE_SHIFT);
     pr_debug("    => [%#.8lx - %#.8lx]\n", vma->vm_start, vma->vm_end);
 
-    vma->vm_ops = &pnc_mmap_vm_ops;
     vma->vm_flags |= VM_RESERVED;
 
-    pfn = _base + mem_offset + offset;
-    for (i = 0; i < nr_pages; i++, pfn++) {
-        r = vm_insert_page(vma, vma->vm_start + i * PAGE_SIZE, pfn_to_page(pfn));
-        if (r != 0) {
-            pr_err("(%s) failed to insert page (%d)\n", __func__, r);
-            return r;
-        }
+    /* Region pages are physically contiguous */
+    r = pnc_mmap_insert_pages(vma, pnc_shm_pfn(mem_offset) + offset,
+        nr_pages);
+    if (r != 0) {
+        /* vma is torn down without close */
+        pnc_shm_map_put(map);
+        return r;
     }
+    /* Mapping counted until vma close */
+    vma->vm_private_data = map;
+    vma->vm_ops = &pnc_mmap_vm_ops;
     return 0;
 }
 
+static int pnc_miscdev_mmap(struct file *filp, struct vm_area_struct *vma)
+{
+    struct pnc_file *f = filp->private_data;
+    int ret;
+
+    down_read(&f->lock);
+    ret = pnc_miscdev_mmap_session(f->session, vma);
+    up_read(&f->lock);
+    return ret;
+}
+
 static int pnc_miscdev_open(struct inode *inode, struct file *filp)
 {
-    return pnc_session_open((pnc_session_t **)&filp->private_data);
+    struct pnc_file *f;
+    int ret;
+
+    f = kzalloc(sizeof(struct pnc_file), GFP_KERNEL);
+    if (f == NULL) {
+        return -ENOMEM;
+    }
+    init_rwsem(&f->lock);
+    ret = pnc_session_open(&f->session);
+    if (ret != 0) {
+        kfree(f);
+        return ret;
+    }
+    filp->private_data = f;
+    return 0;
 }
 
 static int pnc_miscdev_release(struct inode *inode, struct file *filp)
 {
-    pnc_session_close(filp->private_data);
+    struct pnc_file *f = filp->private_data;
+
+    /* Closes session, unless leased from session pool */
+    pnc_session_pool_return(f->session);
     filp->private_data = NULL;
+    kfree(f);
     return 0;
 }
 
@@ -261,10 +464,105 @@ typedef struct pnc_ioctl_params {
     uint32_t timeout;   /**< Optional timeout to wait for event(s), NO_TIMEOUT otherwise */
 } pnc_ioctl_params_t;
 
-static long pnc_miscdev_ioctl(struct file *filp, unsigned int cmd,
+/**
+ * @brief Parameter vector for the \ref TZ_IOCTL_SET_EVENTFD request.
+ */
+typedef struct pnc_eventfd_params {
+    int32_t fd;         /**< Eventfd to bind, negative value to unbind */
+    uint32_t events;    /**< EVENT_PENDING_xxx bitmask of event types */
+} pnc_eventfd_params_t;
+
+/**
+ * @brief Parameter vector for the \ref TZ_IOCTL_LEASE_SID request.
+ */
+typedef struct pnc_lease_params {
+    uint64_t sid;       /**< Service identifier */
+    uint64_t size;      /**< Session memory size in bytes, 0 if none */
+} pnc_lease_params_t;
+
+/**
+ * @brief Parameter vector for the TZ_IOCTL_xxx_REGION requests.
+ */
+typedef struct pnc_region_params {
+    uint32_t id;        /**< Region id: output of attach, input otherwise */
+    uint32_t rfu;       /**< Reserved, keeps size on 64-bit boundary */
+    uint64_t size;      /**< Region size in bytes, ignored by detach */
+} pnc_region_params_t;
+
+/**
+ * @brief Parameter vector for the \ref TZ_IOCTL_REGISTER_BUFFER request.
+ */
+typedef struct pnc_buffer_params {
+    uint64_t addr;      /**< User address of the buffer */
+    uint64_t size;      /**< Buffer size in bytes */
+    uint32_t flags;     /**< PNC_BUFFER_xxx flags */
+    uint32_t handle;    /**< Output buffer handle */
+} pnc_buffer_params_t;
+
+/**
+ * @brief Parameter vector for the \ref TZ_IOCTL_EXPORT_DMABUF and
+ *  \ref TZ_IOCTL_IMPORT_DMABUF requests.
+ */
+typedef struct pnc_dmabuf_params {
+    uint32_t id;        /**< Exported region id */
+    uint32_t flags;     /**< PNC_BUFFER_xxx flags, for import */
+    int32_t fd;         /**< dma-buf fd: output of export, input of import */
+    uint32_t handle;    /**< Output buffer handle, for import */
+} pnc_dmabuf_params_t;
+
+#ifdef CONFIG_PROVENCORE_REE_DMABUF
+/* Importing device of dma-bufs, defined below */
+static struct miscdevice pnc_device;
+#endif
+
+/**
+ * @brief Replace file's session with a session leased from the pool
+ *
+ * Only allowed while file's session is as opened and not used by any other
+ * file operation: its user can't lose any state or mapping.
+ *
+ * @param f             Opened file
+ * @param params        User virtual address of the lease parameters
+ * @return              - 0 on success
+ *                      - -EBUSY if file's session is in use
+ *                      - an error code otherwise
+ */
+static int pnc_miscdev_lease(struct pnc_file *f,
+    pnc_lease_params_t __user *params)
+{
+    pnc_lease_params_t lease_params;
+    pnc_session_t *leased, *s;
+    int ret;
+
+    if (copy_from_user(&lease_params, params, sizeof(lease_params)) != 0) {
+        pr_err("(%s) TZ_IOCTL_LEASE_SID copy failure.\n", __func__);
+        return -EFAULT;
+    }
+
+    if (!down_write_trylock(&f->lock)) {
+        return -EBUSY;
+    }
+    s = f->session;
+    ret = pnc_session_check_unused(s);
+    if (ret == 0) {
+        ret = pnc_session_pool_lease(lease_params.sid,
+                (unsigned long)lease_params.size, &leased);
+    }
+    if (ret == 0) {
+        /* Leased session replaces the one opened with the file */
+        f->session = leased;
+    }
+    up_write(&f->lock);
+
+    if (ret == 0) {
+        pnc_session_pool_return(s);
+    }
+    return ret;
+}
+
+static long pnc_miscdev_session_ioctl(pnc_session_t *s, unsigned int cmd,
                              unsigned long arg)
 {
-    pnc_session_t *s = filp->private_data;
     int ret = 0;
     uint32_t val;
     pnc_ioctl_params_t ioctl_params;
@@ -437,6 +735,133 @@ static long pnc_miscdev_ioctl(struct file *filp, unsigned int cmd,
                 }
             }
             break;
+        case TZ_IOCTL_SET_EVENTFD:
+        {
+            pnc_eventfd_params_t eventfd_params;
+
+            ret = copy_from_user(&eventfd_params, (void *)arg,
+                    sizeof(eventfd_params));
+            if (ret == 0) {
+                ret = pnc_session_set_eventfd(s, eventfd_params.events,
+                        eventfd_params.fd);
+            } else {
+                pr_err("(%s) TZ_IOCTL_SET_EVENTFD copy failure (%d).\n",
+                    __func__, ret);
+                ret = -EFAULT;
+            }
+            break;
+        }
+        case TZ_IOCTL_ATTACH_REGION:
+        case TZ_IOCTL_RESIZE_REGION:
+        case TZ_IOCTL_DETACH_REGION:
+        {
+            pnc_region_params_t region_params;
+
+            ret = copy_from_user(&region_params, (void *)arg,
+                    sizeof(region_params));
+            if (ret != 0) {
+                pr_err("(%s) TZ_IOCTL_xxx_REGION copy failure (%d).\n",
+                    __func__, ret);
+                ret = -EFAULT;
+                break;
+            }
+            if ((cmd & 0xffff) == TZ_IOCTL_RESIZE_REGION) {
+                ret = pnc_session_resize_region(s, region_params.id,
+                        (unsigned long)region_params.size);
+                break;
+            }
+            if ((cmd & 0xffff) == TZ_IOCTL_DETACH_REGION) {
+                ret = pnc_session_detach_region(s, region_params.id);
+                break;
+            }
+            ret = pnc_session_attach_region(s,
+                    (unsigned long)region_params.size, &region_params.id);
+            if (ret == 0 || ret == -ETIMEDOUT) {
+                if (copy_to_user((void *)arg, &region_params,
+                        sizeof(region_params)) != 0) {
+                    pr_err("(%s) TZ_IOCTL_ATTACH_REGION copy failure.\n",
+                        __func__);
+                    ret = -EFAULT;
+                }
+            }
+            break;
+        }
+        case TZ_IOCTL_REGISTER_BUFFER:
+        {
+            pnc_buffer_params_t buffer_params;
+
+            ret = copy_from_user(&buffer_params, (void *)arg,
+                    sizeof(buffer_params));
+            if (ret != 0) {
+                pr_err("(%s) TZ_IOCTL_REGISTER_BUFFER copy failure (%d).\n",
+                    __func__, ret);
+                ret = -EFAULT;
+                break;
+            }
+            ret = pnc_session_register_buffer(s,
+                    (unsigned long)buffer_params.addr,
+                    (unsigned long)buffer_params.size, buffer_params.flags,
+                    &buffer_params.handle);
+            if (ret != 0) {
+                break;
+            }
+            if (copy_to_user((void *)arg, &buffer_params,
+                    sizeof(buffer_params)) != 0) {
+                pr_err("(%s) TZ_IOCTL_REGISTER_BUFFER copy failure.\n",
+                    __func__);
+                pnc_session_unregister_buffer(s, buffer_params.handle);
+                ret = -EFAULT;
+            }
+            break;
+        }
+        case TZ_IOCTL_UNREGISTER_BUFFER:
+            ret = pnc_session_unregister_buffer(s, (uint32_t)arg);
+            break;
+#ifdef CONFIG_PROVENCORE_REE_DMABUF
+        case TZ_IOCTL_EXPORT_DMABUF:
+        case TZ_IOCTL_IMPORT_DMABUF:
+        {
+            pnc_dmabuf_params_t dmabuf_params;
+            struct dma_buf *dmabuf;
+
+            ret = copy_from_user(&dmabuf_params, (void *)arg,
+                    sizeof(dmabuf_params));
+            if (ret != 0) {
+                pr_err("(%s) TZ_IOCTL_xxx_DMABUF copy failure (%d).\n",
+                    __func__, ret);
+                ret = -EFAULT;
+                break;
+            }
+            if ((cmd & 0xffff) == TZ_IOCTL_IMPORT_DMABUF) {
+                ret = pnc_session_import_dmabuf(s, pnc_device.this_device,
+                        dmabuf_params.fd, dmabuf_params.flags,
+                        &dmabuf_params.handle);
+            } else {
+                ret = pnc_session_export_region(s, dmabuf_params.id,
+                        O_RDWR | O_CLOEXEC, &dmabuf);
+                if (ret == 0) {
+                    dmabuf_params.fd = dma_buf_fd(dmabuf, O_CLOEXEC);
+                    if (dmabuf_params.fd < 0) {
+                        ret = dmabuf_params.fd;
+                        dma_buf_put(dmabuf);
+                    }
+                }
+            }
+            if (ret != 0) {
+                break;
+            }
+            if (copy_to_user((void *)arg, &dmabuf_params,
+                    sizeof(dmabuf_params)) != 0) {
+                pr_err("(%s) TZ_IOCTL_xxx_DMABUF copy failure.\n", __func__);
+                /* Exported fd stays installed, closed with the process */
+                if ((cmd & 0xffff) == TZ_IOCTL_IMPORT_DMABUF) {
+                    pnc_session_unregister_buffer(s, dmabuf_params.handle);
+                }
+                ret = -EFAULT;
+            }
+            break;
+        }
+#endif /* CONFIG_PROVENCORE_REE_DMABUF */
         default:
             ret = -ENOTTY;
             break;
@@ -444,13 +869,33 @@ static long pnc_miscdev_ioctl(struct file *filp, unsigned int cmd,
     return ret;
 }
 
+static long pnc_miscdev_ioctl(struct file *filp, unsigned int cmd,
+                             unsigned long arg)
+{
+    struct pnc_file *f = filp->private_data;
+    long ret;
+
+    if ((cmd & 0xffff) == TZ_IOCTL_LEASE_SID) {
+        return pnc_miscdev_lease(f, (void __user *)arg);
+    }
+
+    down_read(&f->lock);
+    ret = pnc_miscdev_session_ioctl(f->session, cmd, arg);
+    up_read(&f->lock);
+    return ret;
+}
+
 static __poll_t pnc_miscdev_poll(struct file *filp, poll_table *wait)
 {
-    pnc_session_t *s = filp->private_data;
+    struct pnc_file *f = filp->private_data;
+    __poll_t ret;
 
     pr_debug("(%s)\n", __func__);
 
-    return pnc_session_poll_wait(s, filp, wait);
+    down_read(&f->lock);
+    ret = pnc_session_poll_wait(f->session, filp, wait);
+    up_read(&f->lock);
+    return ret;
 }
 
 
@@ -692,6 +1137,7 @@ DECLARE_WORK(_sync_work, pnc_sessions_sync);
 static int __init pnc_init(void)
 {
     unsigned long p, pfn;
+    unsigned long mapped_pages;
     int ret;
 #ifndef CONFIG_PROVENCORE_DTS_CONFIGURATION
     struct page *page = NULL;
@@ -707,6 +1153,19 @@ static int __init pnc_init(void)
         return ret;
     }
 
+#ifdef CONFIG_PROVENCORE_REE_DMABUF
+    /*
+     * Misc device attaches imported dma-bufs: without DMA mask, exporters
+     * fail to map them. S accesses pages by physical address, any is fine.
+     */
+    ret = dma_coerce_mask_and_coherent(pnc_device.this_device,
+        DMA_BIT_MASK(64));
+    if (ret) {
+        pr_err("(%s) failed to set DMA mask (%d)\n", __func__, ret);
+        goto err_0;
+    }
+#endif /* CONFIG_PROVENCORE_REE_DMABUF */
+
 #ifdef CONFIG_PROVENCORE_DTS_CONFIGURATION
     /*
      * Lookup the reserved memory area defined in the DTB.
@@ -730,6 +1189,42 @@ static int __init pnc_init(void)
     _base = pfn;
     pr_info("(%s) found %ld reserved pages\n", __func__, _nr_pages);
     pr_info("    physaddr: 0x%lx\n", _base << PAGE_SHIFT);
+#elif defined(CONFIG_PROVENCORE_REE_CMA)
+    /*
+     * Allocate the shared memory from the default CMA area. Pages are
+     * individually ref counted and can be freed as a whole with
+     * cma_release(), no split is required. The area is not bound by the
+     * buddy allocator max order, hence can be much larger than with
+     * alloc_pages().
+     */
+    _nr_pages = (unsigned long)CONFIG_PROVENCORE_REE_CMA_SIZE_MB
+        << (20 - PAGE_SHIFT);
+    if (_nr_pages < REE_RESERVED_PAGES) {
+        pr_err("(%s) reserved memory is too small\n", __func__);
+        ret = -EINVAL;
+        goto err_0;
+    }
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,19,0)
+    page = cma_alloc(dev_get_cma_area(NULL), _nr_pages, 0, false);
+#elif LINUX_VERSION_CODE >= KERNEL_VERSION(4,15,0)
+    page = cma_alloc(dev_get_cma_area(NULL), _nr_pages, 0, GFP_KERNEL);
+#else
+    page = cma_alloc(dev_get_cma_area(NULL), _nr_pages, 0);
+#endif
+    if (page == NULL) {
+        pr_err("(%s) failed to allocate %lu pages from CMA\n", __func__,
+            _nr_pages);
+        ret = -ENOMEM;
+        goto err_0;
+    }
+    _base = page_to_pfn(page);
+    for (p = 0, pfn = _base; p < _nr_pages; p++, pfn++) {
+        clear_highpage(pfn_to_page(pfn));
+    }
+
+    pr_info("(%s) successfully allocated %ld CMA pages\n", __func__,
+        _nr_pages);
+    pr_info("    physaddr: 0x%lx\n", _base << PAGE_SHIFT);
 #else
     /*
      * Allocate (1 << order) contiguous pages in kernel memory. By default,
@@ -761,7 +1256,9 @@ static int __init pnc_init(void)
 
     pr_info("(%s) successfully allocated %ld pages\n", __func__, _nr_pages);
     pr_info("    physaddr: 0x%lx\n", _base << PAGE_SHIFT);
+#endif
 
+#ifndef CONFIG_PROVENCORE_DTS_CONFIGURATION
 #ifdef CONFIG_IRQ_DOMAIN
     /* Bind the trustzone IRQ. */
     _irq = pnc_create_sgi(CONFIG_PROVENCORE_NON_SECURE_IRQ);
@@ -773,32 +1270,41 @@ static int __init pnc_init(void)
 #else
     _irq = CONFIG_PROVENCORE_NON_SECURE_IRQ;
 #endif /* CONFIG_IRQ_DOMAIN */
-#endif /* CONFIG_PROVENCORE_DTS_CONFIGURATION */
+#endif /* !CONFIG_PROVENCORE_DTS_CONFIGURATION */
 
     /*
-     * Map the full memory. Because of the kernel API the kernel may need
+     * Map the memory. Because of the kernel API the kernel may need
      * to access the shared memory directly.
+     * With a CMA backed area, only the REE reserved pages (header, rings)
+     * are mapped upfront: the area can be large and blocks handed out to
+     * sessions are mapped on demand by the block allocator.
      */
-    shmem = kmalloc(_nr_pages * sizeof(struct page *), GFP_KERNEL);
+#ifdef CONFIG_PROVENCORE_REE_CMA
+    mapped_pages = REE_RESERVED_PAGES;
+#else
+    mapped_pages = _nr_pages;
+#endif
+    shmem = kmalloc(mapped_pages * sizeof(struct page *), GFP_KERNEL);
     if (shmem == NULL) {
         pr_err("(%s) failed to allocate shmem pages\n", __func__);
         goto err_1;
     }
-    for (p = 0, pfn = _base; p < _nr_pages; p++, pfn++) {
+    for (p = 0, pfn = _base; p < mapped_pages; p++, pfn++) {
         shmem[p] = pfn_to_page(pfn);
     }
-    _vbase = vmap(shmem, _nr_pages, VM_RESERVED | VM_MAP, PAGE_KERNEL);
+    _vbase = vmap(shmem, mapped_pages, VM_RESERVED | VM_MAP, PAGE_KERNEL);
     kfree(shmem);
     if (_vbase == NULL) {
         pr_err("(%s) failed to map the shared memory\n", __func__);
         goto err_1;
     }
     pr_info("(%s) successfully mapped %lu shared memory pages\n", __func__,
-        _nr_pages);
+        mapped_pages);
     pr_info("    virtaddr: 0x%p\n", _vbase);
 
     /* Initialise the block allocator. */
-    ret = pnc_shm_init(_vbase, (_base << PAGE_SHIFT), _nr_pages);
+    ret = pnc_shm_init(_vbase, (_base << PAGE_SHIFT), _nr_pages,
+        mapped_pages);
     if (ret) {
         pr_err("(%s) failed to initialise block allocator\n", __func__);
         goto err_2;
@@ -851,10 +1357,12 @@ err_3:
 err_2:
     vunmap(_vbase);
 err_1:
-#ifndef CONFIG_PROVENCORE_DTS_CONFIGURATION
+#if defined(CONFIG_PROVENCORE_REE_CMA)
+    cma_release(dev_get_cma_area(NULL), pfn_to_page(_base), _nr_pages);
+#elif !defined(CONFIG_PROVENCORE_DTS_CONFIGURATION)
     for (p = 0, pfn = _base; p < _nr_pages; p++, pfn++)
         __free_page(pfn_to_page(pfn));
-#endif /* !CONFIG_PROVENCORE_DTS_CONFIGURATION */
+#endif
 err_0:
     misc_deregister(&pnc_device);
     _base = 0;
@@ -863,7 +1371,8 @@ err_0:
 
 static void __exit pnc_exit(void)
 {
-#ifndef CONFIG_PROVENCORE_DTS_CONFIGURATION
+#if !defined(CONFIG_PROVENCORE_DTS_CONFIGURATION) && \
+    !defined(CONFIG_PROVENCORE_REE_CMA)
     unsigned long p, pfn;
 #endif
 
@@ -878,17 +1387,27 @@ static void __exit pnc_exit(void)
     pnc_smc_exit();
     pnc_shm_exit();
     vunmap(_vbase);
-#ifndef CONFIG_PROVENCORE_DTS_CONFIGURATION
+#if defined(CONFIG_PROVENCORE_REE_CMA)
+    cma_release(dev_get_cma_area(NULL), pfn_to_page(_base), _nr_pages);
+    _base = 0;
+#elif !defined(CONFIG_PROVENCORE_DTS_CONFIGURATION)
     for (p = 0, pfn = _base; p < _nr_pages; p++, pfn++)
         __free_page(pfn_to_page(pfn));
     _base = 0;
-#endif /* !CONFIG_PROVENCORE_DTS_CONFIGURATION */
+#endif
     misc_deregister(&pnc_device);
 }
 
 module_init(pnc_init);
 module_exit(pnc_exit);
 module_param(order, uint, S_IRUGO);
+#ifdef CONFIG_PROVENCORE_REE_DMABUF
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6,13,0)
+MODULE_IMPORT_NS("DMA_BUF");
+#elif LINUX_VERSION_CODE >= KERNEL_VERSION(5,16,0)
+MODULE_IMPORT_NS(DMA_BUF);
+#endif
+#endif /* CONFIG_PROVENCORE_REE_DMABUF */
 
 MODULE_LICENSE("Dual BSD/GPL");
 MODULE_DESCRIPTION("Provencore REE driver");
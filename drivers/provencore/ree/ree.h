@@ -65,11 +65,16 @@
  * time. MUST be even value less or equal to 28. The length of 28 is a
  * limitation due to the length of the notification register, described below,
  * used to forward S-->NS and NS-->S notifications.
+ * @REE_SHM_REGION_SHIFT: SHM is made of the memory range forwarded at start-up
+ * (region 0) and of optional regions added at runtime. Page offsets used in
+ * messages are offsets in SHM: region k, for k > 0, starts at page offset
+ * k << REE_SHM_REGION_SHIFT, whatever its physical address.
  */
 #define REE_MAGIC_1         UINT32_C(0xdeadcafe)
 #define REE_MAGIC_2         UINT32_C(0xfee1ca4e)
 #define REE_RESERVED_PAGES  3
 #define REE_MAX_SESSIONS    28
+#define REE_SHM_REGION_SHIFT 16
 
 /*
  * Also part of SHM header used at startup to sync with S world.
@@ -106,8 +111,33 @@
  *     add support for direct configuration to a service by its name (string) to 
  *     the kernel API.
  *          See 3.02 changelog for feature details
+ *
+ * - 3.04:
+ *     add support for additional SHM regions attached to a configured session
+ *          On top of the memory range given with A_CONFIG (region 0), NS can
+ *          attach, resize or detach regions at runtime with A_REGION special
+ *          request, acknowledged by S with A_REGION_ACK.
+ *     No compatibility break known: A_REGION is only sent if both worlds
+ *     support 3.04.
+ *
+ * - 3.05:
+ *     add support for SHM regions added and removed at runtime
+ *          NS can extend SHM with discontiguous memory ranges, announced with
+ *          SMC_ADD_SHAREDMEM and retired with SMC_REMOVE_SHAREDMEM once
+ *          unused. See REE_SHM_REGION_SHIFT for their page offsets.
+ *     No compatibility break known: regions are only added if both worlds
+ *     support 3.05 and secure monitor accepts SMC_ADD_SHAREDMEM.
+ *
+ * - 3.06:
+ *     add support for NS user buffers registered for a session
+ *          Buffer pages are pinned by NS and described by a pnc_page_list_t
+ *          written in SHM. The page offset of this list is a handle session
+ *          users exchange in their own messages, so that S accesses the
+ *          buffer in place instead of through session's SHM.
+ *     No compatibility break known: buffers are only registered if both
+ *     worlds support 3.06.
  */
-#define REE_VERSION         UINT32_C(0x303) /* 3.03 */
+#define REE_VERSION         UINT32_C(0x306) /* 3.06 */
 
 /**
  * @brief List of NS <--> S notifications.
@@ -247,7 +277,16 @@ typedef enum session_action
     /**< Special request for session termination. No info in message payload */
     A_TERM,
     /**< A_TERM acknowledge. No info in message payload */
-    A_TERM_ACK
+    A_TERM_ACK,
+    /**< Special request for session's SHM region update (since 3.04).
+     * Message payload contains region id (p0 bits 0-31), request sequence
+     * num (p0 bits 32-63), page offset in SHM (p1) and num of pages (p2).
+     * Region is detached if num of pages is 0, otherwise attached or
+     * replaced with new geometry. */
+    A_REGION,
+    /**< A_REGION acknowledge. Message payload contains acknowledged A_REGION
+     * p0 (region id and sequence num) and update status (p1) */
+    A_REGION_ACK
 } session_action_t;
 
 /**
@@ -408,4 +447,35 @@ typedef struct pnc_shm
 
 _Static_assert((sizeof(pnc_shm_t) <= (REE_RESERVED_PAGES*PAGE_SIZE)), "not enough SHM reserved pages");
 
+/**
+ * @brief Page list describing a NS buffer registered for a session
+ *
+ * Written by NS at the start of a dedicated SHM block, whose page offset is the
+ * buffer handle. The list is read only for S, and stays valid until NS
+ * unregisters the buffer.
+ */
+typedef struct pnc_page_list
+{
+    /** Buffer size in bytes */
+    uint64_t size;
+
+    /** Byte offset of the buffer start in first page */
+    uint32_t first_offset;
+
+    /** Num of entries in \ref pages */
+    uint32_t nr_pages;
+
+    /** PNC_PAGE_LIST_xxx flags */
+    uint32_t flags;
+
+    /** Size of each page, as a power of 2 */
+    uint32_t page_shift;
+
+    /** Physical address of each page */
+    uint64_t pages[];
+} pnc_page_list_t;
+
+/** S may write buffer pages */
+#define PNC_PAGE_LIST_WRITE     BIT(0)
+
 #endif /* REE_H_INCLUDED */
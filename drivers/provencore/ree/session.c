@@ -11,11 +11,24 @@
  *   All rights reserved.
  */
 
+#include <linux/eventfd.h>
+#include <linux/gfp.h>
+#include <linux/list.h>
+#include <linux/mm.h>
 #include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/version.h>
+#include <linux/vmalloc.h>
+#include <linux/wait.h>
 #include <linux/workqueue.h>
 #include <linux/semaphore.h>
 #include <linux/mutex.h>
 
+#ifdef CONFIG_PROVENCORE_REE_DMABUF
+#include <linux/dma-buf.h>
+#include <linux/scatterlist.h>
+#endif /* CONFIG_PROVENCORE_REE_DMABUF */
+
 #include "internal.h"
 #include "ree.h"
 #include "session.h"
@@ -33,6 +46,75 @@
 #define CONFIG_PROVENCORE_REE_SERVICE_TIMEOUT 0
 #endif
 
+#ifndef CONFIG_PROVENCORE_REE_SESSION_POOL_SIZE
+#define CONFIG_PROVENCORE_REE_SESSION_POOL_SIZE 4
+#endif
+
+/** Max num of sub-page SHM objects allocated per session */
+#define SESSION_MAX_OBJS        16
+
+/** Max num of SHM regions per session, including region 0 (A_CONFIG one) */
+#define SESSION_MAX_REGIONS     8
+
+/** Max num of user buffers registered per session */
+#define SESSION_MAX_BUFFERS     16
+
+/** Max size of a registered user buffer, in pages */
+#define SESSION_BUFFER_MAX_PAGES (UINT32_C(1) << 16)
+
+/** Max length of a service name, including terminating null byte */
+#define SESSION_POOL_NAME_LEN   32
+
+/** Num of event types (signal, request, response) an eventfd can be bound to.
+ * Event type i matches EVENT_PENDING_xxx bit i. */
+#define EVENT_PENDING_TYPES     3
+_Static_assert(EVENT_PENDING_ALL == ((UINT32_C(1) << EVENT_PENDING_TYPES) - 1),
+    "EVENT_PENDING_TYPES does not match EVENT_PENDING_ALL");
+
+/**
+ * @brief Completion of an asynchronous request, callback not yet called
+ */
+struct async_completion
+{
+    pnc_session_response_cb_t cb;
+    void *ctx;
+    int status;
+    uint32_t response;
+};
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(4,13,0)
+/* wait_queue_t was renamed struct wait_queue_entry in 4.13 */
+#define wait_queue_entry __wait_queue
+#endif
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(4,12,0)
+#define kvmalloc_array(n, size, flags)  vmalloc((n) * (size))
+#endif
+
+/**
+ * @brief Buffer registered for a session: pinned user pages or imported dma-buf
+ */
+struct session_buffer
+{
+    /** Slot in use */
+    bool used;
+    /** SHM block holding buffer's pnc_page_list_t: its offset is the handle */
+    pnc_shm_block_t list;
+    /** Pinned user pages, NULL if imported dma-buf */
+    struct page **pages;
+    unsigned int nr_pages;
+#ifdef CONFIG_PROVENCORE_REE_DMABUF
+    /** Imported dma-buf attachment and its mapping, if any */
+    struct dma_buf_attachment *attach;
+    struct sg_table *sgt;
+    enum dma_data_direction dir;
+#endif
+    /** S may write buffer pages: they are dirtied when unpinned */
+    bool writable;
+    /** Buffer is unregistered on next response */
+    bool oneshot;
+};
+
 /**
  * @brief handle on a session opened between a linux application and
  *  a Provencore service.
@@ -45,8 +127,37 @@ struct pnc_session
     /** Session index (fixed). */
     unsigned int index;
 
-    /** Allocated memory range. */
+    /** Allocated memory range: points to mem_block if any, NULL otherwise. */
     pnc_shm_block_t *mem;
+    pnc_shm_block_t mem_block;
+
+    /** SHM byte offsets of allocated sub-page objects, 0 if unused slot. */
+    unsigned long objs[SESSION_MAX_OBJS];
+
+    /** Additional SHM regions, unused if nr_pages is 0. Region 0 is \p mem */
+    pnc_shm_block_t regions[SESSION_MAX_REGIONS];
+
+    /**
+     * Former range of each region moved without A_REGION_ACK: S may still
+     * use it until it acknowledges a later update of the region.
+     */
+    pnc_shm_block_t region_stale[SESSION_MAX_REGIONS];
+
+    /** Mutex serializing region updates, held while waiting A_REGION_ACK */
+    struct mutex region_lock;
+
+    /** Region update sent, waiting for A_REGION_ACK */
+    bool region_pending;
+    /** Sequence num of last A_REGION, echoed in its A_REGION_ACK */
+    uint32_t region_seq;
+    /** Status reported by A_REGION_ACK */
+    int region_status;
+
+    /** Wait queue for tasks waiting for A_REGION_ACK */
+    wait_queue_head_t region_wait;
+
+    /** Registered user buffers */
+    struct session_buffer buffers[SESSION_MAX_BUFFERS];
 
     /** Session states. */
     session_state_t global_state;
@@ -63,8 +174,39 @@ struct pnc_session
     /** Pending event(s) for this session */
     uint32_t event_pending;
 
-    /** Wait queue for event polling. */
+    /** Wait queue for tasks waiting for event(s), woken up with event key. */
     wait_queue_head_t event_wait;
+
+    /** Wait queue for event polling, woken up for any event. */
+    wait_queue_head_t poll_waitq;
+
+    /** Eventfd signalled for each event type, if bound by session user */
+    struct eventfd_ctx *event_fd[EVENT_PENDING_TYPES];
+
+    /** Status page mirroring session state to userspace, if mapped */
+    pnc_session_status_t *status;
+
+    /** Session leased from the pool, to be returned to it once used */
+    bool pool_leased;
+
+    /** Service the session is configured for, if leased from the pool */
+    uint64_t pool_sid;
+    char pool_name[SESSION_POOL_NAME_LEN];
+
+    /** Node in @_session_pool while idle */
+    struct list_head pool_node;
+
+    /** Completion callback of pending asynchronous request, if any */
+    pnc_session_response_cb_t async_cb;
+    void *async_ctx;
+
+    /** Asynchronous request completed, callback to call once lock released */
+    struct async_completion async_done;
+
+    /** Handler called for received signal bits matching signal_mask, if any */
+    pnc_session_signal_cb_t signal_cb;
+    void *signal_ctx;
+    uint32_t signal_mask;
 };
 
 /**
@@ -90,6 +232,13 @@ static pnc_session_t _sessions[REE_MAX_SESSIONS];
 /** Mutex to protect @_sessions accesses */
 static DEFINE_MUTEX(_sessions_mutex);
 
+/**
+ * Idle configured sessions, ready to be leased again for the same service.
+ * Least recently returned session first. Protected by @_sessions_mutex.
+ */
+static LIST_HEAD(_session_pool);
+static unsigned int _session_pool_count = 0;
+
 /** Linux private part of the NS --> S ring buffer. */
 static pnc_message_ring_producer_t _ns_to_s_ring;
 
@@ -204,6 +353,302 @@ static void invalidate_sessions(void)
     spin_unlock_irqrestore(&_session_lock, flags);
 }
 
+/**
+ * @brief Signal eventfd(s) bound to some session's event types
+ *
+ * Called with s->sem held.
+ *
+ * @param s         session handle
+ * @param events    EVENT_PENDING_xxx bits just set pending
+ */
+static void signal_session_eventfds(pnc_session_t *s, uint32_t events)
+{
+    unsigned int i;
+
+    for (i = 0; i < EVENT_PENDING_TYPES; i++) {
+        if ((events & (UINT32_C(1) << i)) && s->event_fd[i]) {
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6,8,0)
+            eventfd_signal(s->event_fd[i]);
+#else
+            eventfd_signal(s->event_fd[i], 1);
+#endif
+        }
+    }
+}
+
+/**
+ * @brief Release any eventfd bound to a session
+ *
+ * Called with s->sem held, or once session is not reachable anymore.
+ */
+static void release_session_eventfds(pnc_session_t *s)
+{
+    unsigned int i;
+
+    for (i = 0; i < EVENT_PENDING_TYPES; i++) {
+        if (s->event_fd[i]) {
+            eventfd_ctx_put(s->event_fd[i]);
+            s->event_fd[i] = NULL;
+        }
+    }
+}
+
+/**
+ * @brief Set event(s) pending for a session and notify waiting applications
+ *
+ * Called with s->sem held.
+ *
+ * @param s         session handle
+ * @param events    EVENT_PENDING_xxx bits to set pending
+ */
+static void notify_session_event(pnc_session_t *s, uint32_t events)
+{
+    int nr_exclusive;
+
+    s->event_pending |= events;
+
+    /* Only wake up tasks waiting for these events and, among them, a single
+     * exclusive waiter, unless session is going down: all events are then set
+     * pending and every waiter must leave.
+     */
+    nr_exclusive = (events == EVENT_PENDING_ALL) ? 0 : 1;
+    __wake_up(&s->event_wait, TASK_INTERRUPTIBLE, nr_exclusive,
+        (void *)(uintptr_t)events);
+    wake_up_interruptible_poll(&s->poll_waitq, EPOLLIN | EPOLLRDNORM);
+    signal_session_eventfds(s, events);
+}
+
+/**
+ * @brief Mirror session state into its status page, if any
+ *
+ * Status page is only rewritten when its content changes. Its sequence counter
+ * is odd while being updated so that readers can detect torn reads.
+ *
+ * Called with s->sem held.
+ *
+ * @param s         session handle
+ */
+static void publish_session_status(pnc_session_t *s)
+{
+    pnc_session_status_t *st = s->status;
+
+    if (st == NULL ||
+        (st->event_pending == s->event_pending &&
+         st->global_state == s->global_state &&
+         st->client_state == s->client_state &&
+         st->server_state == s->server_state)) {
+        return;
+    }
+
+    WRITE_ONCE(st->seq, st->seq + 1);
+    smp_wmb();
+    WRITE_ONCE(st->event_pending, s->event_pending);
+    WRITE_ONCE(st->global_state, s->global_state);
+    WRITE_ONCE(st->client_state, s->client_state);
+    WRITE_ONCE(st->server_state, s->server_state);
+    smp_wmb();
+    WRITE_ONCE(st->seq, st->seq + 1);
+}
+
+/**
+ * @brief Release session's lock, publishing its new state to status page
+ *
+ * @param s         session handle
+ */
+static void session_up(pnc_session_t *s)
+{
+    publish_session_status(s);
+    up(&s->sem);
+}
+
+/**
+ * @brief Drop session's reference on its status page
+ *
+ * Page stays alive as long as it is mapped in some process, with its last
+ * published content.
+ *
+ * Called with s->sem held, or once session is not reachable anymore.
+ */
+static void release_session_status(pnc_session_t *s)
+{
+    if (s->status) {
+        put_page(virt_to_page(s->status));
+        s->status = NULL;
+    }
+}
+
+/**
+ * @brief Release all sub-page objects allocated for a session
+ *
+ * Called with s->sem held, or once session is not reachable anymore.
+ */
+static void release_session_objs(pnc_session_t *s)
+{
+    unsigned int i;
+
+    for (i = 0; i < SESSION_MAX_OBJS; i++) {
+        if (s->objs[i] != 0) {
+            pnc_shm_obj_free(s->objs[i]);
+            s->objs[i] = 0;
+        }
+    }
+}
+
+/**
+ * @brief Release all additional SHM regions of a session
+ *
+ * Called with s->sem held, or once session is not reachable anymore. Regions
+ * still mapped in userspace are only released with their last mapping.
+ */
+static void release_session_regions(pnc_session_t *s)
+{
+    unsigned int i;
+
+    for (i = 1; i < SESSION_MAX_REGIONS; i++) {
+        pnc_shm_free(&s->regions[i]);
+        pnc_shm_free(&s->region_stale[i]);
+    }
+    /* Wake up any task waiting for A_REGION_ACK: session is going down */
+    s->region_pending = false;
+    wake_up_interruptible(&s->region_wait);
+}
+
+#ifdef CONFIG_PROVENCORE_REE_DMABUF
+/**
+ * @brief Unmap and detach an imported dma-buf
+ */
+static void release_session_dmabuf(struct session_buffer *buf)
+{
+    struct dma_buf *dmabuf = buf->attach->dmabuf;
+
+    if (buf->sgt != NULL) {
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6,2,0)
+        dma_buf_unmap_attachment_unlocked(buf->attach, buf->sgt, buf->dir);
+#else
+        dma_buf_unmap_attachment(buf->attach, buf->sgt, buf->dir);
+#endif
+        buf->sgt = NULL;
+    }
+    dma_buf_detach(dmabuf, buf->attach);
+    dma_buf_put(dmabuf);
+    buf->attach = NULL;
+}
+#endif /* CONFIG_PROVENCORE_REE_DMABUF */
+
+/**
+ * @brief Unpin a registered buffer and release its page list
+ */
+static void release_session_buffer(struct session_buffer *buf)
+{
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5,6,0)
+    unsigned int i;
+#endif
+
+    pnc_shm_free(&buf->list);
+    buf->used = false;
+#ifdef CONFIG_PROVENCORE_REE_DMABUF
+    if (buf->attach != NULL) {
+        release_session_dmabuf(buf);
+        return;
+    }
+#endif
+    if (buf->pages == NULL) {
+        return;
+    }
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5,6,0)
+    unpin_user_pages_dirty_lock(buf->pages, buf->nr_pages, buf->writable);
+#else
+    for (i = 0; i < buf->nr_pages; i++) {
+        if (buf->writable) {
+            set_page_dirty_lock(buf->pages[i]);
+        }
+        put_page(buf->pages[i]);
+    }
+#endif
+    kvfree(buf->pages);
+    buf->pages = NULL;
+    buf->nr_pages = 0;
+}
+
+/**
+ * @brief Release registered user buffers of a session
+ *
+ * Called with s->sem held, or once session is not reachable anymore.
+ *
+ * @param s             session handle
+ * @param oneshot_only  only release buffers registered for a single request
+ */
+static void release_session_buffers(pnc_session_t *s, bool oneshot_only)
+{
+    unsigned int i;
+
+    for (i = 0; i < SESSION_MAX_BUFFERS; i++) {
+        if (s->buffers[i].used &&
+            (!oneshot_only || s->buffers[i].oneshot)) {
+            release_session_buffer(&s->buffers[i]);
+        }
+    }
+}
+
+/**
+ * @brief Complete pending asynchronous request, if any
+ *
+ * Client is back to S_IDLE. Request's callback is only recorded, it is up to
+ * the caller to call it once session's lock released.
+ *
+ * Called with s->sem held.
+ *
+ * @param s         session handle
+ * @param status    0 if \p response received, negative error otherwise
+ * @param response  S response
+ */
+static void complete_async_request(pnc_session_t *s, int status,
+    uint32_t response)
+{
+    if (s->async_cb == NULL) {
+        return;
+    }
+    s->async_done.cb = s->async_cb;
+    s->async_done.ctx = s->async_ctx;
+    s->async_done.status = status;
+    s->async_done.response = response;
+    s->async_cb = NULL;
+    s->async_ctx = NULL;
+    s->client_state = S_IDLE;
+}
+
+/**
+ * @brief Fetch completed asynchronous request, if any
+ *
+ * Called with s->sem held.
+ *
+ * @param s         session handle
+ * @param done      updated with completion, cb set to NULL if none
+ */
+static void take_async_completion(pnc_session_t *s,
+    struct async_completion *done)
+{
+    *done = s->async_done;
+    memset(&s->async_done, 0, sizeof(s->async_done));
+}
+
+/**
+ * @brief Release session's lock, then call completed asynchronous request
+ *  callback if any
+ *
+ * @param s         session handle
+ */
+static void session_up_and_complete(pnc_session_t *s)
+{
+    struct async_completion done;
+
+    take_async_completion(s, &done);
+    session_up(s);
+    if (done.cb != NULL) {
+        done.cb(s, done.status, done.response, done.ctx);
+    }
+}
+
 /* ========================================================================== *
  *   Code for NOTIF_S_MESSAGE handling                                        *
  * ========================================================================== */
@@ -223,8 +668,7 @@ static void handle_s_request(pnc_message_t *ree_msg_ptr)
                 /* Copy S request */
                 memcpy(&s->server_message, ree_msg_ptr, sizeof(pnc_message_t));
                 /* Notify any application waiting for new request */
-                s->event_pending |= EVENT_PENDING_REQUEST;
-                wake_up_interruptible(&s->event_wait);
+                notify_session_event(s, EVENT_PENDING_REQUEST);
                 /* Update server state */
                 s->server_state = S_NOTIFIED;
                 break;
@@ -248,11 +692,17 @@ static void handle_s_response(pnc_message_t *ree_msg_ptr)
         switch (s->client_state) {
             case S_WAITING:
             case S_CANCEL_WAITING:
+                /* Request is over: S is done with one-shot buffers */
+                release_session_buffers(s, true);
+                if (s->async_cb != NULL) {
+                    /* Asynchronous request: only reported to its callback */
+                    complete_async_request(s, 0, ree_msg_ptr->p1);
+                    break;
+                }
                 /* Copy S response */
                 memcpy(&s->client_message, ree_msg_ptr, sizeof(pnc_message_t));
                 /* Notify any application waiting for A_RESPONSE */
-                s->event_pending |= EVENT_PENDING_RESPONSE;
-                wake_up_interruptible(&s->event_wait);
+                notify_session_event(s, EVENT_PENDING_RESPONSE);
                 /* Update client state */
                 s->client_state = S_NOTIFIED;
                 break;
@@ -285,8 +735,7 @@ static void handle_s_config_ack(pnc_message_t *ree_msg_ptr)
             memcpy(&s->client_message, ree_msg_ptr, sizeof(pnc_message_t));
         }
         /* Notify any application waiting end of config */
-        s->event_pending |= EVENT_PENDING_RESPONSE;
-        wake_up_interruptible(&s->event_wait);
+        notify_session_event(s, EVENT_PENDING_RESPONSE);
     }
 }
 
@@ -333,11 +782,14 @@ static void handle_s_cancel_ack(pnc_message_t *ree_msg_ptr)
         /* Check client state */
         switch (s->client_state) {
             case S_CANCEL_WAITING:
+                if (s->async_cb != NULL) {
+                    complete_async_request(s, -ECANCELED, 0);
+                    break;
+                }
                 /* Copy S response */
                 memcpy(&s->client_message, ree_msg_ptr, sizeof(pnc_message_t));
                 /* Notify any application waiting for A_CANCEL_ACK */
-                s->event_pending |= EVENT_PENDING_RESPONSE;
-                wake_up_interruptible(&s->event_wait);
+                notify_session_event(s, EVENT_PENDING_RESPONSE);
                 /* Update client state */
                 s->client_state = S_NOTIFIED;
                 break;
@@ -362,8 +814,8 @@ static void handle_s_term(pnc_message_t *ree_msg_ptr)
             memory_order_acquire);
 
         /* Notify any waiting application */
-        s->event_pending = EVENT_PENDING_ALL;
-        wake_up_interruptible(&s->event_wait);
+        notify_session_event(s, EVENT_PENDING_ALL);
+        complete_async_request(s, -EPIPE, 0);
     }
 
     /* Send A_TERM_ACK */
@@ -374,9 +826,31 @@ static void handle_s_term(pnc_message_t *ree_msg_ptr)
     /* Switch session to S_NULL */
     s->global_state = S_NULL;
 
+    /* Wake up any task waiting for A_REGION_ACK */
+    s->region_pending = false;
+    wake_up_interruptible(&s->region_wait);
+
     return;
 }
 
+/*
+ * @brief Handle A_REGION_ACK reception
+ */
+static void handle_s_region_ack(pnc_message_t *ree_msg_ptr)
+{
+    pnc_session_t *s = &_sessions[ree_msg_ptr->index];
+
+    /* Check session state: do nothing if not S_CONFIGURED. Late acknowledge
+     * of a former A_REGION is ignored. */
+    if (s->global_state == S_CONFIGURED && s->region_pending &&
+        (uint32_t)(ree_msg_ptr->p0 >> 32) == s->region_seq) {
+        s->region_status = ree_msg_ptr->p1;
+        s->region_pending = false;
+        /* Notify application waiting for A_REGION_ACK */
+        wake_up_interruptible(&s->region_wait);
+    }
+}
+
 /*
  * @brief Handle A_TERM_ACK reception
  */
@@ -387,8 +861,7 @@ static void handle_s_term_ack(pnc_message_t *ree_msg_ptr)
     /* Check session state: do nothing if not S_TERM_WAITING */
     if (s->global_state == S_TERM_WAITING) {
         /* Notify any application waiting end of session termination */
-        s->event_pending |= EVENT_PENDING_RESPONSE;
-        wake_up_interruptible(&s->event_wait);
+        notify_session_event(s, EVENT_PENDING_RESPONSE);
     }
 }
 
@@ -447,13 +920,23 @@ static void handle_s_message(pnc_message_t *ree_msg_ptr)
             handle_s_term_ack(ree_msg_ptr);
             break;
 
+        case A_REGION:
+            /* It is NS responsible for A_REGION sending, can't receive it...
+             * Simply ignore...
+             */
+            break;
+
+        case A_REGION_ACK:
+            handle_s_region_ack(ree_msg_ptr);
+            break;
+
         default:
             pr_err("(%s) unknown message (%u) for session %u\n", __func__,
                 ree_msg_ptr->action, ree_msg_ptr->index);
             break;
     }
 
-    up(&s->sem);
+    session_up_and_complete(s);
     return;
 }
 
@@ -462,13 +945,35 @@ static void handle_s_message(pnc_message_t *ree_msg_ptr)
  */
 static void handle_s_signal(pnc_session_t *s)
 {
+    pnc_session_signal_cb_t cb;
+    void *ctx;
+    uint32_t signals = 0, others;
+
     down(&s->sem);
 
-    /* Wake up any application waiting for new signal */
-    s->event_pending |= EVENT_PENDING_SIGNAL;
-    wake_up_interruptible(&s->event_wait);
+    cb = s->signal_cb;
+    ctx = s->signal_ctx;
+    if (cb != NULL) {
+        /* Acknowledge signal bits handled by registered handler, leaving the
+         * other ones pending for session user */
+        others = atomic_fetch_and_explicit(&_s_to_ns_signals[s->index],
+            ~s->signal_mask, memory_order_acquire);
+        signals = others & s->signal_mask;
+        others &= ~s->signal_mask;
+    } else {
+        others = 1;
+    }
+
+    if (others != 0) {
+        /* Wake up any application waiting for new signal */
+        notify_session_event(s, EVENT_PENDING_SIGNAL);
+    }
+
+    session_up(s);
 
-    up(&s->sem);
+    if (signals != 0) {
+        cb(s, signals, ctx);
+    }
 
     return;
 }
@@ -683,7 +1188,13 @@ int pnc_sessions_init(void)
         _sessions[index].event_pending = 0;
         sema_init(&_sessions[index].sem, 1);
         init_waitqueue_head(&_sessions[index].event_wait);
+        init_waitqueue_head(&_sessions[index].poll_waitq);
+        INIT_LIST_HEAD(&_sessions[index].pool_node);
+        mutex_init(&_sessions[index].region_lock);
+        init_waitqueue_head(&_sessions[index].region_wait);
     }
+    INIT_LIST_HEAD(&_session_pool);
+    _session_pool_count = 0;
     _signal_session = &_sessions[0];
     return 0;
 }
@@ -746,6 +1257,86 @@ int pnc_session_get_mem_offset(pnc_session_t *session,
     return 0;
 }
 
+int pnc_session_get_region_offset(pnc_session_t *session, unsigned int id,
+    unsigned long *offset, unsigned long *nr_pages)
+{
+    if (id == 0) {
+        return pnc_session_get_mem_offset(session, offset, nr_pages);
+    }
+    if (session == NULL || id >= SESSION_MAX_REGIONS) {
+        pr_err("(%s) invalid session or region\n", __func__);
+        return -EINVAL;
+    }
+    if (session->regions[id].nr_pages == 0) {
+        return -ENOMEM;
+    }
+
+    if (offset != NULL) {
+        *offset = session->regions[id].offset;
+    }
+    if (nr_pages != NULL) {
+        *nr_pages = session->regions[id].nr_pages;
+    }
+    return 0;
+}
+
+int pnc_session_map_region(pnc_session_t *s, unsigned int id,
+    unsigned long *offset, unsigned long *nr_pages, struct pnc_shm_map **map)
+{
+    pnc_shm_block_t *b;
+    int ret;
+
+    if (s == NULL || offset == NULL || map == NULL ||
+        id >= SESSION_MAX_REGIONS) {
+        pr_err("(%s) invalid session or region\n", __func__);
+        return -EINVAL;
+    }
+
+    /* Region can't be resized or detached in the meantime */
+    if (mutex_lock_interruptible(&s->region_lock)) {
+        return -ERESTARTSYS;
+    }
+    ret = pnc_session_get_region_offset(s, id, offset, nr_pages);
+    if (ret == 0) {
+        b = (id == 0) ? s->mem : &s->regions[id];
+        *map = pnc_shm_map_get(b);
+        if (IS_ERR(*map)) {
+            ret = PTR_ERR(*map);
+        }
+    }
+    mutex_unlock(&s->region_lock);
+    return ret;
+}
+
+int pnc_session_get_status_page(pnc_session_t *s, struct page **page)
+{
+    unsigned long addr;
+
+    if (s == NULL || page == NULL) {
+        pr_err("(%s) invalid session\n", __func__);
+        return -EINVAL;
+    }
+
+    if (down_interruptible(&s->sem)) {
+        pr_err("%s: interrupted while waiting semaphore.\n", __func__);
+        return -ERESTARTSYS;
+    }
+    if (s->status == NULL) {
+        addr = get_zeroed_page(GFP_KERNEL);
+        if (addr == 0) {
+            up(&s->sem);
+            pr_err("(%s) can't allocate status page\n", __func__);
+            return -ENOMEM;
+        }
+        s->status = (pnc_session_status_t *)addr;
+    }
+    *page = virt_to_page(s->status);
+    get_page(*page);
+    /* Publish current state */
+    session_up(s);
+    return 0;
+}
+
 void pnc_sessions_sync(struct work_struct *work)
 {
     (void)work;
@@ -756,8 +1347,74 @@ void pnc_sessions_sync(struct work_struct *work)
     pr_info("Framework ready with version 0x%x\n", _ree_version);
 }
 
-/* ========================================================================== *
- *   Code for session public Kernel API                                       *
+int pnc_session_set_eventfd(pnc_session_t *s, uint32_t events, int fd)
+{
+    struct eventfd_ctx *ctx[EVENT_PENDING_TYPES] = { NULL };
+    struct eventfd_ctx *old;
+    unsigned int i;
+    int ret = 0;
+
+    if (s == NULL) {
+        pr_err("(%s) invalid session\n", __func__);
+        return -EINVAL;
+    }
+    if ((events == 0) || (events & ~EVENT_PENDING_ALL)) {
+        pr_err("(%s) invalid events (0x%x)\n", __func__, events);
+        return -EINVAL;
+    }
+
+    /* Take one eventfd reference per bound event type: fd < 0 unbinds */
+    if (fd >= 0) {
+        for (i = 0; i < EVENT_PENDING_TYPES; i++) {
+            if (!(events & (UINT32_C(1) << i)))
+                continue;
+            ctx[i] = eventfd_ctx_fdget(fd);
+            if (IS_ERR(ctx[i])) {
+                ret = PTR_ERR(ctx[i]);
+                ctx[i] = NULL;
+                goto end_set;
+            }
+        }
+    }
+
+    if (down_interruptible(&s->sem)) {
+        pr_err("%s: interrupted while waiting semaphore.\n", __func__);
+        ret = -ERESTARTSYS;
+        goto end_set;
+    }
+
+    if (s->free) {
+        pr_err("(%s) closed session\n", __func__);
+        session_up(s);
+        ret = -EINVAL;
+        goto end_set;
+    }
+
+    for (i = 0; i < EVENT_PENDING_TYPES; i++) {
+        if (!(events & (UINT32_C(1) << i)))
+            continue;
+        old = s->event_fd[i];
+        s->event_fd[i] = ctx[i];
+        /* Old context, if any, released below, out of critical section */
+        ctx[i] = old;
+    }
+
+    /* Don't let new eventfd miss event(s) already pending */
+    if (fd >= 0)
+        signal_session_eventfds(s, s->event_pending & events);
+
+    session_up(s);
+
+end_set:
+    for (i = 0; i < EVENT_PENDING_TYPES; i++) {
+        if (ctx[i])
+            eventfd_ctx_put(ctx[i]);
+    }
+    return ret;
+}
+
+/* ========================================================================== *
+ *   Code for session public Kernel API                                       *
  *   Descriptions of exported symbol in include/misc/provencore/session.h     *
  * ========================================================================== */
 
@@ -826,7 +1483,7 @@ static int check_session_configured(pnc_session_t *s)
     ret = 0;
 
 end_check:
-    up(&s->sem);
+    session_up(s);
     return ret;
 }
 
@@ -853,7 +1510,7 @@ static int check_and_handle_terminated_session(pnc_session_t *session)
     if (session->global_state == S_TERM_WAITING) {
         /* It is normal session is not configured after wait... */
         session->global_state = S_NULL;
-        up(&session->sem);
+        session_up(session);
         return 0;
     }
 
@@ -867,48 +1524,94 @@ static int check_and_handle_terminated_session(pnc_session_t *session)
         pnc_shm_free(session->mem);
         session->mem = NULL;
     }
-    up(&session->sem);
+    release_session_objs(session);
+    release_session_regions(session);
+    release_session_buffers(session, false);
+    release_session_eventfds(session);
+    publish_session_status(session);
+    release_session_status(session);
+    session_up(session);
     mutex_lock(&_sessions_mutex);
+    session->pool_leased = false;
     session->free = 1;
     mutex_unlock(&_sessions_mutex);
 
     return -EPIPE;
 }
 
+/**
+ * @brief Wait queue entry of a task waiting for some session's event(s)
+ *
+ * Session's wait queue is woken up with the EVENT_PENDING_xxx bits just set
+ * pending as key: only waiters whose mask matches this key are woken up.
+ */
+struct session_waiter {
+    struct wait_queue_entry entry;
+    /** EVENT_PENDING_xxx bits the task is waiting for */
+    uint32_t mask;
+};
+
+static int session_wake_function(struct wait_queue_entry *entry,
+    unsigned int mode, int sync, void *key)
+{
+    struct session_waiter *waiter = container_of(entry, struct session_waiter,
+        entry);
+
+    /* Not interested in these events: not woken up, and not counted as an
+     * exclusive wake up either */
+    if (!((uint32_t)(uintptr_t)key & waiter->mask))
+        return 0;
+
+    return autoremove_wake_function(entry, mode, sync, key);
+}
+
 static int wait_session_event(pnc_session_t *s, uint32_t mask, uint32_t *events,
     uint32_t timeout)
 {
+    struct session_waiter waiter;
+    bool exclusive;
+    long remaining;
     int ret;
 
+    /* Exclusive waiters are woken up one at a time for a given event */
+    exclusive = (mask & EVENT_WAIT_EXCLUSIVE) != 0;
+
     /* Filter out invalid events */
     mask &= EVENT_PENDING_ALL;
 
-    /* Wait for A_RESPONSE reception */
     if (timeout != 0) {
-        /* Wait for a while...
-         * Returns:
-         *  - 0 if condition evaluated to false after timeout elapsed
-         *  - 1 if condition evaluated to true after timeout elapsed
-         *  - the remaining jiffies (at least 1) if the condition
-         *      evaluated to true before the timeout elapsed
-         *  - -ERESTARTSYS if it was interrupted by a signal
-         */
-        ret = wait_event_interruptible_timeout(s->event_wait,
-                (s->event_pending & mask), (timeout * HZ) / 1000);
-        if (ret == 0) {
-            ret = -ETIMEDOUT;
-        } else if (ret >= 1) {
+        remaining = (timeout * HZ) / 1000;
+    } else {
+        remaining = MAX_SCHEDULE_TIMEOUT;
+    }
+
+    init_wait(&waiter.entry);
+    waiter.entry.func = session_wake_function;
+    waiter.mask = mask;
+
+    /* Wait for any of the events in mask, a system signal or timeout */
+    for (;;) {
+        if (exclusive) {
+            prepare_to_wait_exclusive(&s->event_wait, &waiter.entry,
+                TASK_INTERRUPTIBLE);
+        } else {
+            prepare_to_wait(&s->event_wait, &waiter.entry, TASK_INTERRUPTIBLE);
+        }
+        if (READ_ONCE(s->event_pending) & mask) {
             ret = 0;
+            break;
         }
-    } else {
-        /*
-         * Returns:
-         *  - 0 if condition evaluated to true
-         *  - -ERESTARTSYS if it was interrupted by a signal
-         */
-        ret = wait_event_interruptible(s->event_wait,
-                (s->event_pending & mask));
+        if (signal_pending(current)) {
+            ret = -ERESTARTSYS;
+            break;
+        }
+        if (remaining == 0) {
+            ret = -ETIMEDOUT;
+            break;
+        }
+        remaining = schedule_timeout(remaining);
     }
+    finish_wait(&s->event_wait, &waiter.entry);
 
     if (down_interruptible(&s->sem)) {
         pr_err("%s: interrupted while waiting semaphore.\n", __func__);
@@ -921,8 +1624,15 @@ static int wait_session_event(pnc_session_t *s, uint32_t mask, uint32_t *events,
         }
         /* Clear pending event(s) we were waiting for */
         s->event_pending &= ~mask;
+    } else if (exclusive && (s->event_pending & mask)) {
+        /* We may have been woken up as the exclusive waiter but are leaving
+         * without consuming the event(s): pass the wake up on to another
+         * exclusive waiter, if any.
+         */
+        __wake_up(&s->event_wait, TASK_INTERRUPTIBLE, 1,
+            (void *)(uintptr_t)(s->event_pending & mask));
     }
-    up(&s->sem);
+    session_up(s);
 
     /* Need to check if session broken or terminated while waiting response */
     int ret2 = check_and_handle_terminated_session(s);
@@ -963,7 +1673,7 @@ static void send_term(pnc_session_t *s)
 
     /* Switch session to S_TERM_WAITING */
     s->global_state = S_TERM_WAITING;
-    up(&s->sem);
+    session_up(s);
 
     /* Notify request */
     notify_ns_message();
@@ -989,7 +1699,8 @@ static void send_term(pnc_session_t *s)
  *              -ENODEV: session not configured...
  *              -EBUSY: client is busy, NOK to send new request
  */
-static int send_request(pnc_session_t *s, uint32_t request)
+static int send_request(pnc_session_t *s, uint32_t request,
+    pnc_session_response_cb_t cb, void *ctx)
 {
     pnc_message_t ree_msg = {0};
 
@@ -1003,7 +1714,7 @@ static int send_request(pnc_session_t *s, uint32_t request)
     if (s->client_state != S_IDLE) {
         pr_err("(%s) session %u client is not ready for sending request (%u)\n",
             __func__, s->index, (unsigned int)s->client_state);
-        up(&s->sem);
+        session_up(s);
         return -EPROTO;
     }
 
@@ -1016,7 +1727,9 @@ static int send_request(pnc_session_t *s, uint32_t request)
     write_ns_message(&ree_msg);
     /* notify S */
     s->client_state = S_WAITING;
-    up(&s->sem);
+    s->async_cb = cb;
+    s->async_ctx = ctx;
+    session_up(s);
     notify_ns_message();
 
     return 0;
@@ -1037,7 +1750,7 @@ static int get_response(pnc_session_t *s, uint32_t *response)
     if (s->client_state != S_NOTIFIED) {
         /* Client busy, not really an error here: return -EAGAIN as a status */
         pr_warn("(%s) client busy (%d/%u)\n", __func__, s->index, s->client_state);
-        up(&s->sem);
+        session_up(s);
         return -EAGAIN;
     }
 
@@ -1050,7 +1763,7 @@ static int get_response(pnc_session_t *s, uint32_t *response)
 
     s->event_pending &= ~EVENT_PENDING_RESPONSE;
 
-    up(&s->sem);
+    session_up(s);
 
     return 0;
 }
@@ -1058,10 +1771,12 @@ static int get_response(pnc_session_t *s, uint32_t *response)
 int pnc_session_open(pnc_session_t **session)
 {
     unsigned int index;
+    pnc_session_t *victim;
 
     /* Wait for global synchro between NS and S regarding SHM initialization */
     wait_event(_session_waitq, _session_ready);
 
+retry:
     mutex_lock(&_sessions_mutex);
     /* Allocate a session handle. */
     for (index = 0; index < REE_MAX_SESSIONS; index++) {
@@ -1075,7 +1790,19 @@ int pnc_session_open(pnc_session_t **session)
             return 0;
         }
     }
+    /* No free slot: give up the least recently used idle pooled session, if
+     * any */
+    victim = list_first_entry_or_null(&_session_pool, pnc_session_t,
+        pool_node);
+    if (victim != NULL) {
+        list_del_init(&victim->pool_node);
+        _session_pool_count--;
+    }
     mutex_unlock(&_sessions_mutex);
+    if (victim != NULL) {
+        pnc_session_close(victim);
+        goto retry;
+    }
     /* Fail if all session handles are used. */
     pr_err("(%s) no free session slot\n", __func__);
     return -ENOMEM;
@@ -1085,6 +1812,7 @@ EXPORT_SYMBOL(pnc_session_open);
 void pnc_session_close(pnc_session_t *session)
 {
     int ret;
+    struct async_completion done;
     if (session != NULL) {
         ret = check_session_configured(session);
         if (ret == 0) {
@@ -1097,12 +1825,31 @@ void pnc_session_close(pnc_session_t *session)
         session->global_state = S_NULL;
         pnc_shm_free(session->mem);
         session->mem = NULL;
-        /* Notify any waiting application */
-        session->event_pending = EVENT_PENDING_ALL;
-        wake_up_interruptible(&session->event_wait);
+        release_session_objs(session);
+        release_session_regions(session);
+        release_session_buffers(session, false);
+        /* Notify any waiting application, then drop bound eventfds */
+        notify_session_event(session, EVENT_PENDING_ALL);
+        release_session_eventfds(session);
+        complete_async_request(session, -EPIPE, 0);
+        session->signal_cb = NULL;
+        session->signal_ctx = NULL;
+        session->signal_mask = 0;
+        /* Last status seen by userspace: session closed */
+        publish_session_status(session);
+        release_session_status(session);
+        take_async_completion(session, &done);
         if (ret == 0)
             up(&session->sem);
+        if (done.cb != NULL) {
+            done.cb(session, done.status, done.response, done.ctx);
+        }
         mutex_lock(&_sessions_mutex);
+        if (!list_empty(&session->pool_node)) {
+            list_del_init(&session->pool_node);
+            _session_pool_count--;
+        }
+        session->pool_leased = false;
         session->free = 1;
         mutex_unlock(&_sessions_mutex);
     }
@@ -1123,6 +1870,8 @@ EXPORT_SYMBOL(pnc_session_get_version);
 
 int pnc_session_alloc(pnc_session_t *session, unsigned long size)
 {
+    int ret;
+
     if (session->mem != NULL) {
         pr_err("(%s) Session already configured\n", __func__);
         return -EEXIST;
@@ -1132,10 +1881,650 @@ int pnc_session_alloc(pnc_session_t *session, unsigned long size)
         return -EINVAL;
     }
     size += PAGE_SIZE - 1;
-    return pnc_shm_alloc(size >> PAGE_SHIFT, &session->mem);
+    ret = pnc_shm_alloc(size >> PAGE_SHIFT, &session->mem_block);
+    if (ret == 0) {
+        session->mem = &session->mem_block;
+    }
+    return ret;
 }
 EXPORT_SYMBOL(pnc_session_alloc);
 
+int pnc_session_alloc_obj(pnc_session_t *session, size_t size,
+    unsigned long *offset, void **ptr)
+{
+    unsigned int i;
+    unsigned long obj;
+    int ret;
+
+    if (session == NULL || offset == NULL) {
+        pr_err("(%s) Bad descriptors\n", __func__);
+        return -EINVAL;
+    }
+
+    if (down_interruptible(&session->sem)) {
+        pr_err("%s: interrupted while waiting semaphore.\n", __func__);
+        return -ERESTARTSYS;
+    }
+    for (i = 0; i < SESSION_MAX_OBJS; i++) {
+        if (session->objs[i] == 0) {
+            break;
+        }
+    }
+    if (i == SESSION_MAX_OBJS) {
+        pr_err("(%s) too many objects for session %u\n", __func__,
+            session->index);
+        ret = -ENOSPC;
+        goto end;
+    }
+    ret = pnc_shm_obj_alloc(size, &obj);
+    if (ret != 0) {
+        goto end;
+    }
+    session->objs[i] = obj;
+    *offset = obj;
+    if (ptr != NULL) {
+        *ptr = pnc_shm_obj_vaddr(obj);
+    }
+end:
+    session_up(session);
+    return ret;
+}
+EXPORT_SYMBOL(pnc_session_alloc_obj);
+
+int pnc_session_free_obj(pnc_session_t *session, unsigned long offset)
+{
+    unsigned int i;
+    int ret = -EINVAL;
+
+    if (session == NULL || offset == 0) {
+        pr_err("(%s) Bad descriptors\n", __func__);
+        return -EINVAL;
+    }
+
+    if (down_interruptible(&session->sem)) {
+        pr_err("%s: interrupted while waiting semaphore.\n", __func__);
+        return -ERESTARTSYS;
+    }
+    for (i = 0; i < SESSION_MAX_OBJS; i++) {
+        if (session->objs[i] == offset) {
+            ret = pnc_shm_obj_free(offset);
+            session->objs[i] = 0;
+            break;
+        }
+    }
+    session_up(session);
+    return ret;
+}
+EXPORT_SYMBOL(pnc_session_free_obj);
+
+/**
+ * @brief Get a free registered buffer slot
+ *
+ * Called with s->sem held.
+ *
+ * @return free slot, marked used, NULL if none left
+ */
+static struct session_buffer *get_session_buffer(pnc_session_t *s)
+{
+    unsigned int i;
+
+    for (i = 0; i < SESSION_MAX_BUFFERS; i++) {
+        if (!s->buffers[i].used) {
+            memset(&s->buffers[i], 0, sizeof(struct session_buffer));
+            s->buffers[i].used = true;
+            return &s->buffers[i];
+        }
+    }
+    pr_err("(%s) too many buffers for session %u\n", __func__, s->index);
+    return NULL;
+}
+
+/**
+ * @brief Allocate the SHM page list of a registered buffer
+ *
+ * List header is filled in, page addresses are left to the caller.
+ *
+ * @return page list, NULL on allocation failure
+ */
+static pnc_page_list_t *alloc_buffer_page_list(struct session_buffer *buf,
+    unsigned long size, unsigned int first_offset, unsigned long nr_pages,
+    bool writable)
+{
+    pnc_page_list_t *list;
+
+    if (pnc_shm_alloc((sizeof(pnc_page_list_t) + nr_pages * sizeof(uint64_t)
+            + PAGE_SIZE - 1) >> PAGE_SHIFT, &buf->list) != 0) {
+        return NULL;
+    }
+    list = pnc_shm_block_vaddr(&buf->list);
+    if (list == NULL) {
+        return NULL;
+    }
+    list->size = size;
+    list->first_offset = first_offset;
+    list->nr_pages = nr_pages;
+    list->flags = writable ? PNC_PAGE_LIST_WRITE : 0;
+    list->page_shift = PAGE_SHIFT;
+    return list;
+}
+
+int pnc_session_register_buffer(pnc_session_t *s, unsigned long addr,
+    unsigned long size, uint32_t flags, uint32_t *handle)
+{
+    struct session_buffer *buf = NULL;
+    struct page **pages;
+    pnc_page_list_t *list;
+    unsigned long nr_pages;
+    unsigned int i;
+    int pinned, ret;
+
+    if (s == NULL || handle == NULL || size == 0 ||
+        (flags & ~(PNC_BUFFER_WRITE | PNC_BUFFER_ONESHOT)) != 0) {
+        pr_err("(%s) invalid parameters\n", __func__);
+        return -EINVAL;
+    }
+    if (_ree_version < 0x306) {
+        pr_err("(%s) not supported by REE version 0x%x\n", __func__,
+            _ree_version);
+        return -ENOTSUPP;
+    }
+    if (size > ((unsigned long)SESSION_BUFFER_MAX_PAGES << PAGE_SHIFT)) {
+        return -E2BIG;
+    }
+    nr_pages = (offset_in_page(addr) + size + PAGE_SIZE - 1) >> PAGE_SHIFT;
+
+    if (down_interruptible(&s->sem)) {
+        pr_err("%s: interrupted while waiting semaphore.\n", __func__);
+        return -ERESTARTSYS;
+    }
+    buf = get_session_buffer(s);
+    if (buf == NULL) {
+        ret = -ENOSPC;
+        goto end;
+    }
+
+    pages = kvmalloc_array(nr_pages, sizeof(struct page *), GFP_KERNEL);
+    if (pages == NULL) {
+        ret = -ENOMEM;
+        goto err;
+    }
+    /* Buffer may stay registered for long: pages must not be migrated */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5,6,0)
+    pinned = pin_user_pages_fast(addr & PAGE_MASK, nr_pages,
+        FOLL_LONGTERM | ((flags & PNC_BUFFER_WRITE) ? FOLL_WRITE : 0), pages);
+#else
+    /* 3rd argument is either write flag or gup flags: FOLL_WRITE is 1 */
+    pinned = get_user_pages_fast(addr & PAGE_MASK, nr_pages,
+        (flags & PNC_BUFFER_WRITE) ? 1 : 0, pages);
+#endif
+    if (pinned < 0) {
+        ret = pinned;
+        kvfree(pages);
+        goto err;
+    }
+    buf->pages = pages;
+    buf->nr_pages = pinned;
+    buf->writable = (flags & PNC_BUFFER_WRITE) != 0;
+    buf->oneshot = (flags & PNC_BUFFER_ONESHOT) != 0;
+    if (pinned != nr_pages) {
+        ret = -EFAULT;
+        goto err;
+    }
+
+    /* Describe pinned pages to S */
+    list = alloc_buffer_page_list(buf, size, offset_in_page(addr), nr_pages,
+        buf->writable);
+    if (list == NULL) {
+        ret = -ENOMEM;
+        goto err;
+    }
+    for (i = 0; i < nr_pages; i++) {
+        list->pages[i] = page_to_phys(pages[i]);
+    }
+    *handle = buf->list.offset;
+    pr_debug("(%s) session %u: %lu pages registered as %#x\n", __func__,
+        s->index, nr_pages, *handle);
+    goto end;
+
+err:
+    release_session_buffer(buf);
+end:
+    session_up(s);
+    return ret;
+}
+
+int pnc_session_unregister_buffer(pnc_session_t *s, uint32_t handle)
+{
+    unsigned int i;
+    int ret = -ENOENT;
+
+    if (s == NULL) {
+        pr_err("(%s) Bad descriptors\n", __func__);
+        return -EINVAL;
+    }
+
+    if (down_interruptible(&s->sem)) {
+        pr_err("%s: interrupted while waiting semaphore.\n", __func__);
+        return -ERESTARTSYS;
+    }
+    for (i = 0; i < SESSION_MAX_BUFFERS; i++) {
+        if (!s->buffers[i].used || s->buffers[i].list.offset != handle) {
+            continue;
+        }
+        if (s->client_state == S_WAITING ||
+            s->client_state == S_CANCEL_WAITING) {
+            /* S may be accessing buffer pages while processing request */
+            ret = -EBUSY;
+        } else {
+            release_session_buffer(&s->buffers[i]);
+            ret = 0;
+        }
+        break;
+    }
+    session_up(s);
+    return ret;
+}
+
+#ifdef CONFIG_PROVENCORE_REE_DMABUF
+int pnc_session_import_dmabuf(pnc_session_t *s, struct device *dev, int fd,
+    uint32_t flags, uint32_t *handle)
+{
+    struct session_buffer *buf;
+    struct dma_buf *dmabuf;
+    struct scatterlist *sg;
+    pnc_page_list_t *list;
+    unsigned long nr_pages = 0, n;
+    unsigned int i, j;
+    int ret;
+
+    if (s == NULL || dev == NULL || handle == NULL ||
+        (flags & ~(PNC_BUFFER_WRITE | PNC_BUFFER_ONESHOT)) != 0) {
+        pr_err("(%s) invalid parameters\n", __func__);
+        return -EINVAL;
+    }
+    if (_ree_version < 0x306) {
+        pr_err("(%s) not supported by REE version 0x%x\n", __func__,
+            _ree_version);
+        return -ENOTSUPP;
+    }
+
+    dmabuf = dma_buf_get(fd);
+    if (IS_ERR(dmabuf)) {
+        return PTR_ERR(dmabuf);
+    }
+
+    if (down_interruptible(&s->sem)) {
+        pr_err("%s: interrupted while waiting semaphore.\n", __func__);
+        dma_buf_put(dmabuf);
+        return -ERESTARTSYS;
+    }
+    buf = get_session_buffer(s);
+    if (buf == NULL) {
+        dma_buf_put(dmabuf);
+        ret = -ENOSPC;
+        goto end;
+    }
+    buf->oneshot = (flags & PNC_BUFFER_ONESHOT) != 0;
+    buf->dir = (flags & PNC_BUFFER_WRITE) ? DMA_BIDIRECTIONAL : DMA_TO_DEVICE;
+    buf->attach = dma_buf_attach(dmabuf, dev);
+    if (IS_ERR(buf->attach)) {
+        ret = PTR_ERR(buf->attach);
+        buf->attach = NULL;
+        buf->used = false;
+        dma_buf_put(dmabuf);
+        goto end;
+    }
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6,2,0)
+    buf->sgt = dma_buf_map_attachment_unlocked(buf->attach, buf->dir);
+#else
+    buf->sgt = dma_buf_map_attachment(buf->attach, buf->dir);
+#endif
+    if (IS_ERR(buf->sgt)) {
+        ret = PTR_ERR(buf->sgt);
+        buf->sgt = NULL;
+        goto err;
+    }
+
+    /* S accesses whole pages by physical address */
+    for_each_sg(buf->sgt->sgl, sg, buf->sgt->orig_nents, i) {
+        if (sg_page(sg) == NULL || sg->offset != 0 ||
+            !PAGE_ALIGNED(sg->length)) {
+            pr_err("(%s) dma-buf pages not usable\n", __func__);
+            ret = -EINVAL;
+            goto err;
+        }
+        nr_pages += sg->length >> PAGE_SHIFT;
+    }
+    if (nr_pages == 0 || nr_pages > SESSION_BUFFER_MAX_PAGES) {
+        ret = -E2BIG;
+        goto err;
+    }
+
+    list = alloc_buffer_page_list(buf, nr_pages << PAGE_SHIFT, 0, nr_pages,
+        (flags & PNC_BUFFER_WRITE) != 0);
+    if (list == NULL) {
+        ret = -ENOMEM;
+        goto err;
+    }
+    n = 0;
+    for_each_sg(buf->sgt->sgl, sg, buf->sgt->orig_nents, i) {
+        for (j = 0; j < (sg->length >> PAGE_SHIFT); j++) {
+            list->pages[n++] = page_to_phys(sg_page(sg) + j);
+        }
+    }
+    *handle = buf->list.offset;
+    pr_debug("(%s) session %u: dma-buf of %lu pages registered as %#x\n",
+        __func__, s->index, nr_pages, *handle);
+    ret = 0;
+    goto end;
+
+err:
+    release_session_buffer(buf);
+end:
+    session_up(s);
+    return ret;
+}
+
+int pnc_session_export_region(pnc_session_t *s, unsigned int id, int flags,
+    struct dma_buf **dmabuf)
+{
+    pnc_shm_block_t *b;
+    int ret = 0;
+
+    if (s == NULL || dmabuf == NULL || id >= SESSION_MAX_REGIONS) {
+        pr_err("(%s) invalid parameters\n", __func__);
+        return -EINVAL;
+    }
+
+    /* Region can't be resized or detached in the meantime */
+    mutex_lock(&s->region_lock);
+    if (down_interruptible(&s->sem)) {
+        pr_err("%s: interrupted while waiting semaphore.\n", __func__);
+        mutex_unlock(&s->region_lock);
+        return -ERESTARTSYS;
+    }
+    b = (id == 0) ? s->mem : &s->regions[id];
+    if (b == NULL || b->nr_pages == 0) {
+        ret = -ENOENT;
+    } else {
+        *dmabuf = pnc_shm_export_dmabuf(b, flags);
+        if (IS_ERR(*dmabuf)) {
+            ret = PTR_ERR(*dmabuf);
+        }
+    }
+    session_up(s);
+    mutex_unlock(&s->region_lock);
+    return ret;
+}
+#endif /* CONFIG_PROVENCORE_REE_DMABUF */
+
+/**
+ * @brief Send A_REGION and wait for A_REGION_ACK
+ *
+ * Called with s->region_lock held.
+ *
+ * @param s         session handle
+ * @param id        region id
+ * @param b         new region geometry, NULL to detach region
+ * @return 0 on success, strictly positive S error, or negative error:
+ *             - -ENOTSUPP: REE version not supporting regions
+ *             - -ENODEV: session not configured
+ *             - -ETIMEDOUT: no acknowledge in time, or wait interrupted: S
+ *               may apply update or not, both geometries must be kept
+ *             - -EPIPE: session terminated while waiting
+ *             - -ERESTARTSYS: system error, before A_REGION is sent
+ */
+static int send_region(pnc_session_t *s, unsigned int id, pnc_shm_block_t *b)
+{
+    pnc_message_t ree_msg = {0};
+    int ret;
+
+    if (_ree_version < 0x304) {
+        pr_err("(%s) not supported by REE version 0x%x\n", __func__,
+            _ree_version);
+        return -ENOTSUPP;
+    }
+
+    if (down_interruptible(&s->sem)) {
+        pr_err("%s: interrupted while waiting semaphore.\n", __func__);
+        return -ERESTARTSYS;
+    }
+    if (s->global_state != S_CONFIGURED) {
+        session_up(s);
+        return -ENODEV;
+    }
+
+    ree_msg.index = s->index;
+    ree_msg.action = A_REGION;
+    s->region_seq++;
+    ree_msg.p0 = id | ((uint64_t)s->region_seq << 32);
+    if (b != NULL) {
+        ree_msg.p1 = b->offset;
+        ree_msg.p2 = b->nr_pages;
+    }
+    write_ns_message(&ree_msg);
+    s->region_pending = true;
+    s->region_status = 0;
+    session_up(s);
+    notify_ns_message();
+
+    if (CONFIG_PROVENCORE_REE_SERVICE_TIMEOUT != 0) {
+        wait_event_interruptible_timeout(s->region_wait,
+            !READ_ONCE(s->region_pending),
+            msecs_to_jiffies(CONFIG_PROVENCORE_REE_SERVICE_TIMEOUT));
+    } else {
+        wait_event_interruptible(s->region_wait,
+            !READ_ONCE(s->region_pending));
+    }
+
+    down(&s->sem);
+    if (s->global_state != S_CONFIGURED) {
+        ret = -EPIPE;
+    } else if (s->region_pending) {
+        /* A_REGION was sent: S may still apply it. Stop waiting, any late
+         * A_REGION_ACK is ignored */
+        s->region_pending = false;
+        ret = -ETIMEDOUT;
+    } else {
+        ret = s->region_status;
+    }
+    session_up(s);
+    return ret;
+}
+
+int pnc_session_attach_region(pnc_session_t *s, unsigned long size,
+    unsigned int *id)
+{
+    unsigned int i;
+    int ret;
+
+    if (s == NULL || id == NULL || size == 0) {
+        pr_err("(%s) invalid parameters\n", __func__);
+        return -EINVAL;
+    }
+
+    mutex_lock(&s->region_lock);
+    for (i = 1; i < SESSION_MAX_REGIONS; i++) {
+        if (s->regions[i].nr_pages == 0) {
+            break;
+        }
+    }
+    if (i == SESSION_MAX_REGIONS) {
+        ret = -ENOSPC;
+        goto end;
+    }
+
+    ret = pnc_shm_alloc((size + PAGE_SIZE - 1) >> PAGE_SHIFT, &s->regions[i]);
+    if (ret != 0) {
+        goto end;
+    }
+    ret = send_region(s, i, &s->regions[i]);
+    if (ret != 0 && ret != -ETIMEDOUT) {
+        /* S is not using this region */
+        pnc_shm_free(&s->regions[i]);
+        goto end;
+    }
+    /* On timeout, S may still use region: keep it until detach or close */
+    *id = i;
+end:
+    mutex_unlock(&s->region_lock);
+    return ret;
+}
+EXPORT_SYMBOL(pnc_session_attach_region);
+
+int pnc_session_detach_region(pnc_session_t *s, unsigned int id)
+{
+    int ret;
+
+    if (s == NULL || id == 0 || id >= SESSION_MAX_REGIONS) {
+        pr_err("(%s) invalid parameters\n", __func__);
+        return -EINVAL;
+    }
+
+    mutex_lock(&s->region_lock);
+    if (s->regions[id].nr_pages == 0) {
+        ret = -ENOENT;
+        goto end;
+    }
+    if (pnc_shm_is_mapped(&s->regions[id])) {
+        /* Pages would be reused while still mapped in userspace */
+        ret = -EBUSY;
+        goto end;
+    }
+    ret = send_region(s, id, NULL);
+    if (ret == 0 || ret == -ENODEV || ret == -EPIPE) {
+        /* S is not using this region anymore */
+        pnc_shm_free(&s->regions[id]);
+        pnc_shm_free(&s->region_stale[id]);
+    }
+end:
+    mutex_unlock(&s->region_lock);
+    return ret;
+}
+EXPORT_SYMBOL(pnc_session_detach_region);
+
+int pnc_session_resize_region(pnc_session_t *s, unsigned int id,
+    unsigned long size)
+{
+    pnc_shm_block_t *b, moved;
+    unsigned int nr_pages = (size + PAGE_SIZE - 1) >> PAGE_SHIFT;
+    unsigned int old_nr_pages;
+    char *src, *dst;
+    int ret;
+
+    if (s == NULL || id == 0 || id >= SESSION_MAX_REGIONS || size == 0) {
+        pr_err("(%s) invalid parameters\n", __func__);
+        return -EINVAL;
+    }
+
+    mutex_lock(&s->region_lock);
+    b = &s->regions[id];
+    old_nr_pages = b->nr_pages;
+    if (old_nr_pages == 0) {
+        ret = -ENOENT;
+        goto end;
+    }
+    /* Same geometry is sent again if S may still use a former one */
+    if (nr_pages == old_nr_pages && s->region_stale[id].nr_pages == 0) {
+        ret = 0;
+        goto end;
+    }
+
+    if (nr_pages < old_nr_pages) {
+        if (pnc_shm_is_mapped(b)) {
+            ret = -EBUSY;
+            goto end;
+        }
+        /* Shrink in place, once S stopped using the tail. Whole region is
+         * kept if S may still use it */
+        moved = *b;
+        moved.nr_pages = nr_pages;
+        ret = send_region(s, id, &moved);
+        if (ret == 0) {
+            pnc_shm_resize(b, nr_pages);
+            pnc_shm_free(&s->region_stale[id]);
+        }
+        goto end;
+    }
+
+    /* Grow in place if pages after region are free: they are zeroed */
+    if (pnc_shm_resize(b, nr_pages) == 0) {
+        ret = send_region(s, id, b);
+        if (ret == 0) {
+            pnc_shm_free(&s->region_stale[id]);
+        } else if (ret != -ETIMEDOUT) {
+            /* S still uses former geometry */
+            pnc_shm_resize(b, old_nr_pages);
+        }
+        goto end;
+    }
+
+    /* Otherwise move region content to a new range. Not while mapped, nor
+     * while S may still use a former range: it would have to be kept too */
+    if (pnc_shm_is_mapped(b) || s->region_stale[id].nr_pages != 0) {
+        ret = -EBUSY;
+        goto end;
+    }
+    ret = pnc_shm_alloc(nr_pages, &moved);
+    if (ret != 0) {
+        goto end;
+    }
+    src = pnc_shm_block_vaddr(b);
+    dst = pnc_shm_block_vaddr(&moved);
+    if (src == NULL || dst == NULL) {
+        pnc_shm_free(&moved);
+        ret = -ENOMEM;
+        goto end;
+    }
+    /* Tail of the new range is already zeroed */
+    memcpy(dst, src, (unsigned long)old_nr_pages << PAGE_SHIFT);
+    ret = send_region(s, id, &moved);
+    if (ret == 0) {
+        pnc_shm_free(b);
+        *b = moved;
+    } else if (ret == -ETIMEDOUT) {
+        /* S may use either range: keep both, region stays where it was */
+        s->region_stale[id] = moved;
+    } else {
+        pnc_shm_free(&moved);
+    }
+end:
+    mutex_unlock(&s->region_lock);
+    return ret;
+}
+EXPORT_SYMBOL(pnc_session_resize_region);
+
+int pnc_session_get_region(pnc_session_t *session, unsigned int id, char **ptr,
+    unsigned long *size)
+{
+    pnc_shm_block_t *b;
+    unsigned long nr_pages;
+    int ret;
+
+    if (pnc_shm_base() == NULL) {
+        pr_err("(%s) !!!! SHM not allocated\n", __func__);
+        return -ENODEV;
+    }
+
+    ret = pnc_session_get_region_offset(session, id, NULL, &nr_pages);
+    if (ret != 0) {
+        return ret;
+    }
+    b = (id == 0) ? session->mem : &session->regions[id];
+    if (ptr != NULL) {
+        /* Region may not be mapped in kernel yet */
+        *ptr = pnc_shm_block_vaddr(b);
+        if (*ptr == NULL) {
+            return -ENOMEM;
+        }
+    }
+    if (size != NULL) {
+        *size = nr_pages * PAGE_SIZE;
+    }
+    return 0;
+}
+EXPORT_SYMBOL(pnc_session_get_region);
+
 static int configure_session(pnc_session_t *s, uint64_t sid, const char *name)
 {
     int ret;
@@ -1143,6 +2532,7 @@ static int configure_session(pnc_session_t *s, uint64_t sid, const char *name)
     unsigned long flags;
     uint32_t local_sessions;
     void *base = pnc_shm_base();
+    char *mem_vaddr;
 
     if (name != NULL) {
         pr_debug("(%s) index=%u name=%s\n", __func__, s->index, name);
@@ -1174,21 +2564,21 @@ static int configure_session(pnc_session_t *s, uint64_t sid, const char *name)
     /* Check session is not invalid */
     if (s->index >= REE_MAX_SESSIONS) {
         pr_err("(%s) session invalid (%u)\n", __func__, s->index);
-        up(&s->sem);
+        session_up(s);
         return -EINVAL;
     }
 
     /* Check session is not closed */
     if (s->free) {
         pr_err("(%s) configuring closed session.\n", __func__);
-        up(&s->sem);
+        session_up(s);
         return -EINVAL;
     }
 
     if (s->global_state != S_NULL) {
         pr_err("(%s) session not in null state (%u)\n", __func__,
                 (unsigned int)s->global_state);
-        up(&s->sem);
+        session_up(s);
         return -EBADF;
     }
 
@@ -1207,7 +2597,12 @@ static int configure_session(pnc_session_t *s, uint64_t sid, const char *name)
             pr_err("invalid service name\n");
             return -EOVERFLOW;
         }
-        strcpy((char *)base + (s->mem->offset * PAGE_SIZE), name);
+        mem_vaddr = pnc_shm_block_vaddr(s->mem);
+        if (mem_vaddr == NULL) {
+            session_up(s);
+            return -ENOMEM;
+        }
+        strcpy(mem_vaddr, name);
     }
 
     /* Set SID marking bits */
@@ -1228,7 +2623,7 @@ static int configure_session(pnc_session_t *s, uint64_t sid, const char *name)
     write_ns_message(&ree_msg);
     /* Notify S */
     s->global_state = S_CONFIG_WAITING;
-    up(&s->sem);
+    session_up(s);
     notify_ns_message();
 
     /* We will now wait for A_CONFIG_ACK reception and session to become
@@ -1254,7 +2649,7 @@ static int configure_session(pnc_session_t *s, uint64_t sid, const char *name)
             pr_err("(%s) system issue\n", __func__);
             ret = -ENODEV;
         }
-        up(&s->sem);
+        session_up(s);
         goto end_config;
     }
     pr_err("(%s) wait config failure (%d)\n", __func__, ret);
@@ -1275,14 +2670,239 @@ int pnc_session_config(pnc_session_t *session, uint64_t sid)
 }
 EXPORT_SYMBOL(pnc_session_config);
 
+/* ========================================================================== *
+ *   Pool of configured sessions                                              *
+ * ========================================================================== */
+
+/**
+ * @brief Reset an idle pooled session so that it can be leased again
+ *
+ * Session can only be reused if it is still configured, with no request nor
+ * response in progress on any side. Its pending events and signals, bound
+ * eventfds, status page and SHM content are cleared.
+ *
+ * @param s         session handle, not owned by any user
+ * @return true if session was reset, false if it has to be closed
+ */
+static bool reset_pooled_session(pnc_session_t *s)
+{
+    void *mem_vaddr;
+    unsigned int i;
+    bool clean;
+
+    if (down_interruptible(&s->sem)) {
+        pr_err("%s: interrupted while waiting semaphore.\n", __func__);
+        return false;
+    }
+    clean = (s->global_state == S_CONFIGURED) &&
+            (s->client_state == S_IDLE) &&
+            (s->server_state == S_IDLE);
+    /* Additional regions would have to be detached from S first */
+    for (i = 1; i < SESSION_MAX_REGIONS; i++) {
+        if (s->regions[i].nr_pages != 0) {
+            clean = false;
+        }
+    }
+    /* Previous user would still access next one's SHM area */
+    if (pnc_shm_is_exported(s->mem) || pnc_shm_is_mapped(s->mem)) {
+        clean = false;
+    }
+    if (clean) {
+        atomic_exchange_explicit(&_ns_to_s_signals[s->index], 0,
+            memory_order_acquire);
+        atomic_exchange_explicit(&_s_to_ns_signals[s->index], 0,
+            memory_order_acquire);
+        s->event_pending = 0;
+        memset(&s->client_message, 0, sizeof(pnc_message_t));
+        memset(&s->server_message, 0, sizeof(pnc_message_t));
+        release_session_eventfds(s);
+        release_session_status(s);
+        release_session_objs(s);
+        release_session_buffers(s, false);
+        s->signal_cb = NULL;
+        s->signal_ctx = NULL;
+        s->signal_mask = 0;
+        if (s->mem != NULL) {
+            mem_vaddr = pnc_shm_block_vaddr(s->mem);
+            if (mem_vaddr != NULL) {
+                memset(mem_vaddr, 0, s->mem->nr_pages * PAGE_SIZE);
+            }
+        }
+    }
+    session_up(s);
+    return clean;
+}
+
+/**
+ * @brief Lease a session configured for a given service
+ *
+ * An idle pooled session matching the service and memory size is reused if
+ * any. Otherwise a new session is opened, allocated and configured.
+ */
+static int session_pool_lease(uint64_t sid, const char *name,
+    unsigned long size, pnc_session_t **session)
+{
+    pnc_session_t *s;
+    unsigned long nr_pages = (size + PAGE_SIZE - 1) >> PAGE_SHIFT;
+    bool found;
+    int ret;
+
+    if (session == NULL) {
+        pr_err("(%s) Bad descriptors\n", __func__);
+        return -EBADF;
+    }
+
+    for (;;) {
+        found = false;
+        mutex_lock(&_sessions_mutex);
+        list_for_each_entry(s, &_session_pool, pool_node) {
+            if (s->pool_sid != sid ||
+                strcmp(s->pool_name, (name != NULL) ? name : "") != 0) {
+                continue;
+            }
+            if ((s->mem != NULL ? s->mem->nr_pages : 0) != nr_pages) {
+                continue;
+            }
+            list_del_init(&s->pool_node);
+            _session_pool_count--;
+            found = true;
+            break;
+        }
+        mutex_unlock(&_sessions_mutex);
+        if (!found) {
+            break;
+        }
+        /* S may have terminated or used session while it was idle */
+        if (reset_pooled_session(s)) {
+            *session = s;
+            return 0;
+        }
+        pnc_session_close(s);
+    }
+
+    ret = pnc_session_open(&s);
+    if (ret != 0) {
+        return ret;
+    }
+    if (size != 0) {
+        ret = pnc_session_alloc(s, size);
+        if (ret != 0) {
+            goto close;
+        }
+    }
+    ret = configure_session(s, sid, name);
+    if (ret != 0) {
+        goto close;
+    }
+
+    s->pool_sid = sid;
+    s->pool_name[0] = '\0';
+    s->pool_leased = true;
+    if (name != NULL &&
+        strscpy(s->pool_name, name, sizeof(s->pool_name)) < 0) {
+        /* Can't be matched later on: not worth pooling */
+        s->pool_leased = false;
+    }
+    *session = s;
+    return 0;
+
+close:
+    pnc_session_close(s);
+    return ret;
+}
+
+int pnc_session_pool_lease(uint64_t sid, unsigned long size,
+    pnc_session_t **session)
+{
+    return session_pool_lease(sid, NULL, size, session);
+}
+EXPORT_SYMBOL(pnc_session_pool_lease);
+
+int pnc_session_pool_lease_by_name(const char *name, unsigned long size,
+    pnc_session_t **session)
+{
+    if (name == NULL) {
+        pr_err("(%s) invalid service name\n", __func__);
+        return -EINVAL;
+    }
+    return session_pool_lease(TZ_CONFIG_ARG_GETSYSPROC_SID, name, size,
+        session);
+}
+EXPORT_SYMBOL(pnc_session_pool_lease_by_name);
+
+int pnc_session_check_unused(pnc_session_t *s)
+{
+    unsigned int i;
+    int ret = 0;
+
+    if (s == NULL) {
+        pr_err("(%s) Bad descriptors\n", __func__);
+        return -EINVAL;
+    }
+
+    if (down_interruptible(&s->sem)) {
+        pr_err("%s: interrupted while waiting semaphore.\n", __func__);
+        return -ERESTARTSYS;
+    }
+    if (s->global_state != S_NULL || s->mem != NULL || s->status != NULL ||
+        s->signal_cb != NULL) {
+        ret = -EBUSY;
+    }
+    for (i = 0; i < SESSION_MAX_OBJS && ret == 0; i++) {
+        if (s->objs[i] != 0) {
+            ret = -EBUSY;
+        }
+    }
+    for (i = 0; i < SESSION_MAX_BUFFERS && ret == 0; i++) {
+        if (s->buffers[i].used) {
+            ret = -EBUSY;
+        }
+    }
+    for (i = 0; i < EVENT_PENDING_TYPES && ret == 0; i++) {
+        if (s->event_fd[i] != NULL) {
+            ret = -EBUSY;
+        }
+    }
+    session_up(s);
+    return ret;
+}
+
+void pnc_session_pool_return(pnc_session_t *session)
+{
+    pnc_session_t *victim = NULL;
+
+    if (session == NULL) {
+        return;
+    }
+    if (!session->pool_leased || CONFIG_PROVENCORE_REE_SESSION_POOL_SIZE == 0 ||
+        !reset_pooled_session(session)) {
+        pnc_session_close(session);
+        return;
+    }
+
+    mutex_lock(&_sessions_mutex);
+    if (_session_pool_count >= CONFIG_PROVENCORE_REE_SESSION_POOL_SIZE) {
+        /* Pool full: give up least recently used session */
+        victim = list_first_entry(&_session_pool, pnc_session_t, pool_node);
+        list_del_init(&victim->pool_node);
+        _session_pool_count--;
+    }
+    list_add_tail(&session->pool_node, &_session_pool);
+    _session_pool_count++;
+    mutex_unlock(&_sessions_mutex);
+
+    if (victim != NULL) {
+        pnc_session_close(victim);
+    }
+}
+EXPORT_SYMBOL(pnc_session_pool_return);
+
 int pnc_session_get_mem(pnc_session_t *session, char **ptr, unsigned long *size)
 {
     int ret;
-    unsigned long offset;
     unsigned long nr_pages;
-    void *base = pnc_shm_base();
 
-    if (base == NULL) {
+    if (pnc_shm_base() == NULL) {
         /* We MUST check for NULL pointer before using it.
          * Nevertheless, if a session is opened, then REE is setup and SHM 
          * was allocated: such event should never occur...  
@@ -1291,12 +2911,15 @@ int pnc_session_get_mem(pnc_session_t *session, char **ptr, unsigned long *size)
         return -ENODEV;
     }
 
-    ret = pnc_session_get_mem_offset(session, &offset, &nr_pages);
+    ret = pnc_session_get_mem_offset(session, NULL, &nr_pages);
     if (ret != 0) {
         return ret;
     }
     if (ptr != NULL) {
-        *ptr = (char *)base + (offset * PAGE_SIZE);
+        *ptr = pnc_shm_block_vaddr(session->mem);
+        if (*ptr == NULL) {
+            return -ENOMEM;
+        }
     }
     if (size != NULL) {
         *size = nr_pages * PAGE_SIZE;
@@ -1324,7 +2947,7 @@ int pnc_session_send_response(pnc_session_t *s, uint32_t response)
     /* Check server state */
     if (s->server_state != S_BUSY) {
         pr_err("(%s) server in invalid state (%u)\n", __func__, s->server_state);
-        up(&s->sem);
+        session_up(s);
         return -EPROTO;
     }
 
@@ -1337,7 +2960,7 @@ int pnc_session_send_response(pnc_session_t *s, uint32_t response)
     write_ns_message(&ree_msg);
     /* Notify S */
     s->server_state = S_IDLE;
-    up(&s->sem);
+    session_up(s);
     notify_ns_message();
 
     return ret;
@@ -1394,10 +3017,64 @@ int pnc_session_send_request(pnc_session_t *s, uint32_t request)
         return ret;
     }
 
-    return send_request(s, request);
+    return send_request(s, request, NULL, NULL);
 }
 EXPORT_SYMBOL(pnc_session_send_request);
 
+int pnc_session_send_request_async(pnc_session_t *s, uint32_t request,
+    pnc_session_response_cb_t cb, void *ctx)
+{
+    int ret;
+
+    if (cb == NULL) {
+        pr_err("(%s) no completion callback\n", __func__);
+        return -EINVAL;
+    }
+
+    ret = check_session_configured(s);
+    if (ret) {
+        return ret;
+    }
+
+    return send_request(s, request, cb, ctx);
+}
+EXPORT_SYMBOL(pnc_session_send_request_async);
+
+int pnc_session_cancel_request_async(pnc_session_t *s)
+{
+    int ret;
+    pnc_message_t ree_msg = {0};
+
+    ret = check_session_configured(s);
+    if (ret) {
+        return ret;
+    }
+
+    /* Acquire the lock on the session. */
+    if (down_interruptible(&s->sem)) {
+        pr_err("%s: interrupted while waiting semaphore.\n", __func__);
+        return -ERESTARTSYS;
+    }
+
+    if (s->async_cb == NULL) {
+        /* Nothing to cancel, or request already completed */
+        ret = -EPROTO;
+    } else if (s->client_state == S_CANCEL_WAITING) {
+        ret = -EALREADY;
+    } else {
+        /* Try to cancel request: callback will get either A_CANCEL_ACK, as
+         * -ECANCELED, or A_RESPONSE if already in the pipe */
+        ree_msg.index = s->index;
+        ree_msg.action = A_CANCEL;
+        write_ns_message(&ree_msg);
+        s->client_state = S_CANCEL_WAITING;
+        notify_ns_message();
+    }
+    session_up(s);
+    return ret;
+}
+EXPORT_SYMBOL(pnc_session_cancel_request_async);
+
 int pnc_session_get_request(pnc_session_t *s, uint32_t *request)
 {
     int ret;
@@ -1423,7 +3100,7 @@ int pnc_session_get_request(pnc_session_t *s, uint32_t *request)
         /* Not an error here, return -EAGAIN as a status... */
         pr_warn("(%s) server not ready (%d/%u)\n", __func__, s->index,
             s->server_state);
-        up(&s->sem);
+        session_up(s);
         return -EAGAIN;
     }
 
@@ -1436,7 +3113,7 @@ int pnc_session_get_request(pnc_session_t *s, uint32_t *request)
 
     s->event_pending &= ~EVENT_PENDING_REQUEST;
 
-    up(&s->sem);
+    session_up(s);
 
     return 0;
 }
@@ -1467,17 +3144,18 @@ int pnc_session_wait_request(pnc_session_t *s, uint32_t *request,
         /* Any other state is a break in protocol because we're asking for
          * new request whereas previous one wasn't answered.
          */
-        up(&s->sem);
+        session_up(s);
         pr_err("(%s) previous request not answered for session %u\n",
             __func__, s->index);
         return -EPROTO;
     }
-    up(&s->sem);
+    session_up(s);
 
     /* Wait for A_REQUEST reception and session's server to become S_NOTIFIED
      * if not already
      */
-    ret = wait_session_event(s, EVENT_PENDING_REQUEST, NULL, timeout);
+    ret = wait_session_event(s, EVENT_PENDING_REQUEST | EVENT_WAIT_EXCLUSIVE,
+            NULL, timeout);
     if (ret == 0) {
         ret = pnc_session_get_request(s, request);
     }
@@ -1507,6 +3185,12 @@ int pnc_session_cancel_request(pnc_session_t *s, uint32_t *response,
         return -ERESTARTSYS;
     }
 
+    if (s->async_cb != NULL) {
+        pr_err("(%s) asynchronous request pending\n", __func__);
+        session_up(s);
+        return -EPROTO;
+    }
+
     switch (s->client_state) {
         case S_WAITING:
             /* Waiting for previous request's response: try to cancel request */
@@ -1536,7 +3220,7 @@ int pnc_session_cancel_request(pnc_session_t *s, uint32_t *response,
     }
 
     if (s->client_state == S_CANCEL_WAITING) {
-        up(&s->sem);
+        session_up(s);
         /* Wait for A_CANCEL_ACK or A_RESPONSE */
         ret = wait_session_event(s, EVENT_PENDING_RESPONSE, NULL, timeout);
         if (ret == 0) {
@@ -1559,11 +3243,11 @@ int pnc_session_cancel_request(pnc_session_t *s, uint32_t *response,
                 /* Don't know if it can be possible... */
                 ret = -EFAULT;
             }
-            up(&s->sem);
+            session_up(s);
         }
         goto end_cancel;
     }
-    up(&s->sem);
+    session_up(s);
 
 end_cancel:
     return ret;
@@ -1586,7 +3270,7 @@ int pnc_session_send_request_and_wait_response(pnc_session_t *session,
     }
 
     do {
-        ret = send_request(session, request);
+        ret = send_request(session, request, NULL, NULL);
         if (ret != 0) {
             break;
         }
@@ -1664,7 +3348,7 @@ int pnc_session_get_signal(pnc_session_t *s, uint32_t *signals)
 
     s->event_pending &= ~EVENT_PENDING_SIGNAL;
 
-    up(&s->sem);
+    session_up(s);
 
     /* Get and acknowledge received signal(s) if any for this session */
     *signals = atomic_exchange_explicit(&_s_to_ns_signals[s->index], 0,
@@ -1674,6 +3358,39 @@ int pnc_session_get_signal(pnc_session_t *s, uint32_t *signals)
 }
 EXPORT_SYMBOL(pnc_session_get_signal);
 
+int pnc_session_register_signal_handler(pnc_session_t *s, uint32_t mask,
+    pnc_session_signal_cb_t fn, void *ctx)
+{
+    uint32_t pending = 0;
+
+    if (s == NULL || (fn != NULL && mask == 0)) {
+        pr_err("(%s) invalid parameters\n", __func__);
+        return -EINVAL;
+    }
+
+    if (down_interruptible(&s->sem)) {
+        pr_err("%s: interrupted while waiting semaphore.\n", __func__);
+        return -ERESTARTSYS;
+    }
+
+    s->signal_cb = fn;
+    s->signal_ctx = (fn != NULL) ? ctx : NULL;
+    s->signal_mask = (fn != NULL) ? mask : 0;
+    if (fn != NULL) {
+        /* Hand over signal bits already received */
+        pending = atomic_fetch_and_explicit(&_s_to_ns_signals[s->index], ~mask,
+            memory_order_acquire) & mask;
+    }
+
+    session_up(s);
+
+    if (pending != 0) {
+        fn(s, pending, ctx);
+    }
+    return 0;
+}
+EXPORT_SYMBOL(pnc_session_register_signal_handler);
+
 int pnc_session_wait_signal(pnc_session_t *s, uint32_t *signals,
         uint32_t timeout)
 {
@@ -1746,7 +3463,7 @@ __poll_t pnc_session_poll_wait(pnc_session_t *session, struct file *file,
     if (session->event_pending != 0)
         return (EPOLLIN | EPOLLRDNORM);
 
-    poll_wait(file, &session->event_wait, wait);
+    poll_wait(file, &session->poll_waitq, wait);
 
     /* Need to check if session broken or terminated while waiting response */
     int ret = check_and_handle_terminated_session(session);
@@ -19,6 +19,27 @@
 #include <linux/poll.h>
 #include "misc/provencore/ree_session.h"
 
+/**
+ * @brief Session status, as mirrored in a session's read-only status page
+ *
+ * Status page is updated each time the session's lock is released after a
+ * change of state or pending events, so that a session user can check them
+ * without any syscall.
+ *
+ * \p seq is odd while an update is in progress: reader shall read \p seq, then
+ * the other fields, then \p seq again and retry if it was odd or changed.
+ */
+typedef struct pnc_session_status {
+    /** Sequence counter, incremented before and after each update */
+    uint32_t seq;
+    /** EVENT_PENDING_xxx bitfield of pending events */
+    uint32_t event_pending;
+    /** Session states, as session_state_t values */
+    uint32_t global_state;
+    uint32_t client_state;
+    uint32_t server_state;
+} pnc_session_status_t;
+
 /**
  * @brief Handle interrupt (secure SGI) raised by S world to notify new event(s)
  *
@@ -68,6 +89,192 @@ void pnc_sessions_exit(void);
 int pnc_session_get_mem_offset(pnc_session_t *session, unsigned long *offset,
         unsigned long *nr_pages);
 
+/**
+ * @brief Retreive SHM geometry for a given session's region
+ *
+ * Same as \ref pnc_session_get_mem_offset for region 0, the memory range
+ * allocated with \ref pnc_session_alloc. Other regions are the ones attached
+ * with \ref pnc_session_attach_region.
+ *
+ * @param session       session handle
+ * @param id            region id
+ * @param offset        updated with offset of region's SHM area if any
+ * @param nr_pages      updated with num of pages of region's SHM area if any
+ * @return 0 if memory allocated in SHM for this region, negative error
+ *          otherwise:
+ *             - -EINVAL: invalid session or region id
+ *             - -ENOMEM: no memory allocated
+ */
+int pnc_session_get_region_offset(pnc_session_t *session, unsigned int id,
+        unsigned long *offset, unsigned long *nr_pages);
+
+/**
+ * @brief Bind an eventfd to some event type(s) of a session
+ *
+ * Once bound, the eventfd is signalled directly from the S notification path
+ * each time one of the selected EVENT_PENDING_xxx events becomes pending for
+ * this session, without any need for the session user to poll the session.
+ * Event(s) are still to be fetched and acknowledged with the usual
+ * pnc_session_get_xxx functions.
+ *
+ * Binding replaces any eventfd previously bound to the same event type(s).
+ * Eventfds are released when the session is closed.
+ *
+ * @param session       session handle
+ * @param events        EVENT_PENDING_xxx bitmask of event types to bind
+ * @param fd            eventfd file descriptor, or negative value to unbind
+ * @return 0 on success, negative error otherwise:
+ *             - -EINVAL: invalid session or \p events
+ *             - -EBADF: \p fd is not a valid file descriptor
+ *             - -ERESTARTSYS: system error trying to take session's lock
+ */
+int pnc_session_set_eventfd(pnc_session_t *session, uint32_t events, int fd);
+
+/** S may write the registered buffer */
+#define PNC_BUFFER_WRITE        UINT32_C(0x1)
+/** Buffer is unregistered as soon as a response is received for the session */
+#define PNC_BUFFER_ONESHOT      UINT32_C(0x2)
+
+/**
+ * @brief Register a user buffer of the current process for a session
+ *
+ * Buffer pages are pinned and described by a page list written in SHM, so that
+ * S accesses the buffer in place. Returned handle is to be forwarded to the
+ * secure service in session user's own messages.
+ * Buffer stays pinned until unregistered, until next response if
+ * \ref PNC_BUFFER_ONESHOT, or until session is closed.
+ *
+ * @param session       session handle
+ * @param addr          user address of the buffer
+ * @param size          buffer size in bytes
+ * @param flags         PNC_BUFFER_xxx flags
+ * @param handle        updated with buffer handle: page offset of its page
+ *                      list in SHM
+ * @return 0 on success, negative error otherwise:
+ *             - -EINVAL: invalid parameters
+ *             - -ENOTSUPP: REE version not supporting buffers
+ *             - -E2BIG: buffer too large
+ *             - -ENOSPC: too many buffers registered for this session
+ *             - -EFAULT: buffer not fully accessible
+ *             - -ENOMEM: memory allocation failure
+ *             - -ERESTARTSYS: system error trying to take session's lock
+ */
+int pnc_session_register_buffer(pnc_session_t *session, unsigned long addr,
+        unsigned long size, uint32_t flags, uint32_t *handle);
+
+/**
+ * @brief Unregister a user buffer, unpinning its pages
+ *
+ * Not allowed while a request is pending: S may be accessing the buffer.
+ *
+ * @param session       session handle
+ * @param handle        buffer handle
+ * @return 0 on success, negative error otherwise:
+ *             - -EINVAL: invalid session
+ *             - -ENOENT: no such buffer
+ *             - -EBUSY: request pending, S may use the buffer
+ *             - -ERESTARTSYS: system error trying to take session's lock
+ */
+int pnc_session_unregister_buffer(pnc_session_t *session, uint32_t handle);
+
+#ifdef CONFIG_PROVENCORE_REE_DMABUF
+struct dma_buf;
+
+/**
+ * @brief Register a dma-buf as a session buffer
+ *
+ * Same as \ref pnc_session_register_buffer, for a buffer exported by another
+ * driver. dma-buf is attached to \p dev and mapped until unregistered: its
+ * pages must be CPU pages, page aligned, for S to access them by physical
+ * address.
+ *
+ * @param session       session handle
+ * @param dev           importing device
+ * @param fd            dma-buf file descriptor
+ * @param flags         PNC_BUFFER_xxx flags
+ * @param handle        updated with buffer handle
+ * @return 0 on success, negative error otherwise:
+ *             - -EINVAL: invalid parameters or unusable dma-buf pages
+ *             - -EBADF: \p fd is not a dma-buf
+ *             - same as \ref pnc_session_register_buffer otherwise
+ */
+int pnc_session_import_dmabuf(pnc_session_t *session, struct device *dev,
+        int fd, uint32_t flags, uint32_t *handle);
+
+/**
+ * @brief Export a session's region as a dma-buf
+ *
+ * Region pages stay allocated as long as the dma-buf exists, even once the
+ * region is detached or the session closed. Region can't be resized while
+ * exported.
+ *
+ * @param session       session handle
+ * @param id            region id, 0 for session's SHM area
+ * @param flags         dma-buf file flags
+ * @param dmabuf        updated with exported dma-buf
+ * @return 0 on success, negative error otherwise:
+ *             - -EINVAL: invalid parameters
+ *             - -ENOENT: region not allocated
+ *             - -EBUSY: region already exported
+ *             - -ENOMEM: memory allocation failure
+ *             - -ERESTARTSYS: system error trying to take session's lock
+ */
+int pnc_session_export_region(pnc_session_t *session, unsigned int id,
+        int flags, struct dma_buf **dmabuf);
+#endif /* CONFIG_PROVENCORE_REE_DMABUF */
+
+struct pnc_shm_map;
+
+/**
+ * @brief Get SHM geometry of a session's region to map it in userspace
+ *
+ * Region is counted as mapped until \p map is released with
+ * \ref pnc_shm_map_put: it can't be detached, shrunk nor moved in the
+ * meantime, its pages would be reused while still mapped.
+ *
+ * @param session       session handle
+ * @param id            region id, 0 for session's SHM area
+ * @param offset        updated with offset of region's SHM area
+ * @param nr_pages      updated with num of pages of region's SHM area
+ * @param map           updated with region's mapping handle
+ * @return 0 on success, negative error otherwise:
+ *             - -EINVAL: invalid session or region id
+ *             - -ENOMEM: no memory allocated for this region, or allocation
+ *               failure
+ *             - -ERESTARTSYS: interrupted waiting for a region update
+ */
+int pnc_session_map_region(pnc_session_t *session, unsigned int id,
+        unsigned long *offset, unsigned long *nr_pages,
+        struct pnc_shm_map **map);
+
+/**
+ * @brief Get session's status page, allocating it on first call
+ *
+ * A reference is taken on returned page for the caller, typically to map it
+ * in userspace. Session drops its own reference when closed.
+ *
+ * @param session       session handle
+ * @param page          updated with status page
+ * @return 0 on success, negative error otherwise:
+ *             - -EINVAL: invalid session
+ *             - -ENOMEM: can't allocate status page
+ *             - -ERESTARTSYS: system error trying to take session's lock
+ */
+int pnc_session_get_status_page(pnc_session_t *session, struct page **page);
+
+/**
+ * @brief Check a session is still as opened: it can then be given up for
+ *  another one without losing any state of its user
+ *
+ * @param session       session handle
+ * @return 0 if session is neither configured nor holds any memory, buffer,
+ *          eventfd or status page, negative error otherwise:
+ *             - -EINVAL: invalid session
+ *             - -EBUSY: session in use
+ *             - -ERESTARTSYS: system error trying to take session's lock
+ */
+int pnc_session_check_unused(pnc_session_t *session);
+
 /**
  * @brief Wait for end of synchro with S at start up to display REE version.
  * 
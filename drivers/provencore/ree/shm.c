@@ -11,158 +11,1396 @@
  *   All rights reserved.
  */
 
-#include <linux/semaphore.h>
+#include <linux/bitmap.h>
+#include <linux/highmem.h>
+#include <linux/list.h>
+#include <linux/log2.h>
+#include <linux/mm.h>
+#include <linux/mutex.h>
 #include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/version.h>
+#include <linux/vmalloc.h>
+#include <linux/workqueue.h>
+
+#ifdef CONFIG_PROVENCORE_REE_CMA
+#include <linux/cma.h>
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5,10,0)
+#include <linux/dma-map-ops.h>
+#else
+#include <linux/dma-contiguous.h>
+#endif
+#endif /* CONFIG_PROVENCORE_REE_CMA */
+
+#ifdef CONFIG_PROVENCORE_REE_DMABUF
+#include <linux/dma-buf.h>
+#include <linux/dma-mapping.h>
+#include <linux/scatterlist.h>
+#endif /* CONFIG_PROVENCORE_REE_DMABUF */
 
 #include "internal.h"
 #include "shm.h"
 #include "ree.h"
 #include "smc.h"
 
+#ifndef CONFIG_PROVENCORE_REE_SHM_MAX_REGIONS
+#define CONFIG_PROVENCORE_REE_SHM_MAX_REGIONS 4
+#endif
+
+#ifndef CONFIG_PROVENCORE_REE_SHM_REGION_ORDER
+#define CONFIG_PROVENCORE_REE_SHM_REGION_ORDER 9
+#endif
+
+/** Max num of SHM regions, including the one given at init */
+#define SHM_MAX_REGIONS         CONFIG_PROVENCORE_REE_SHM_MAX_REGIONS
+
+/** Max num of pages in a region added at runtime */
+#define SHM_REGION_MAX_PAGES    (1U << REE_SHM_REGION_SHIFT)
+
+/**
+ * Delay before an empty added region is given back: avoids adding and
+ * removing regions over and over under a bursty load.
+ */
+#define SHM_RETIRE_DELAY        (5 * HZ)
+
+/** Max num of pages scrubbed at once by the scrub worker */
+#define SHM_SCRUB_BATCH         16
+
 /** SHM virtual base addr */
 static void *_shm_base = NULL;
 
-/** SHM physical base addr */
-static uint64_t _shm_pbase;
+/** Num of SHM pages mapped at @_shm_base, others are mapped on demand */
+static unsigned int _shm_mapped_pages;
 
-/** SHM total num of pages */
-static unsigned int _shm_nr_pages;
+/** Spinlock used to restrict access to block allocator. */
+static DEFINE_SPINLOCK(_shm_lock);
 
-/** Semaphore used to restrict access to block allocator. */
-static struct semaphore _shm_sem;
+/**
+ * Mutex serializing addition, removal and forwarding of SHM regions to the
+ * secure monitor.
+ */
+static DEFINE_MUTEX(_shm_regions_mutex);
 
 /**
- * List shared memory blocks ; this list constitutes a partition of the total
- * shared memory area.
+ * @brief Physically contiguous range of SHM pages.
+ *
+ * Region 0 is the memory given at init. Others are added at runtime when
+ * allocator runs out of pages, and removed once unused.
  */
-static pnc_shm_block_t *_blocks;
+struct shm_region
+{
+    /* Physical base addr */
+    uint64_t pbase;
+    /* Offset of the first page in SHM */
+    unsigned int offset;
+    /* Region size in pages, 0 if region slot is unused */
+    unsigned int nr_pages;
+    /* Num of used pages */
+    unsigned int nr_used;
+    /* Num of mapped blocks in region: region is kept meanwhile */
+    unsigned int nr_mapped;
+    /* Set while region is being removed: no allocation in it */
+    bool retiring;
+    /*
+     * Page usage bitmap, one bit per region page, set if page is used. Free
+     * ranges are implicitly merged with their free neighbours.
+     */
+    unsigned long *bitmap;
+    /* Dirty bitmap, set for free pages not zeroed yet since last use */
+    unsigned long *dirty;
+    /* Slab descriptor of each region page, if page is a slab. */
+    struct shm_slab **slab_pages;
+};
 
-int pnc_shm_init(void *vbase, uint64_t pbase, unsigned int nr_pages)
+/** SHM regions. Protected by @_shm_lock. */
+static struct shm_region _shm_regions[SHM_MAX_REGIONS];
+
+/** Set if regions can't be added: S world or monitor doesn't support it */
+static bool _shm_hotadd_disabled;
+
+static void shm_retire_work_handler(struct work_struct *work);
+static DECLARE_DELAYED_WORK(_shm_retire_work, shm_retire_work_handler);
+
+/**
+ * Workqueue zeroing freed pages in background. Unbound, with a single work:
+ * it runs at normal priority but yields between batches, its nice value can
+ * be lowered through sysfs.
+ */
+static struct workqueue_struct *_shm_scrub_wq;
+static void shm_scrub_work_handler(struct work_struct *work);
+static DECLARE_WORK(_shm_scrub_work, shm_scrub_work_handler);
+
+/** Smallest object size class, in bytes */
+#define SHM_OBJ_MIN_SIZE        64
+/** Num of object size classes: 64, 128, ..., up to half a page */
+#define SHM_OBJ_CLASSES         (PAGE_SHIFT - 6)
+/** Max num of objects in a slab page */
+#define SHM_OBJ_MAX_PER_PAGE    (PAGE_SIZE / SHM_OBJ_MIN_SIZE)
+
+/**
+ * @brief SHM page carved into objects of a given size class
+ */
+struct shm_slab
 {
-    pnc_shm_block_t *b;
+    /* Node in the list of slabs with free objects for this size class */
+    struct list_head node;
+    /* Slab page */
+    pnc_shm_block_t block;
+    /* Size class index */
+    unsigned int class;
+    /* Num of free objects in the slab */
+    unsigned int nr_free;
+    /* Used objects */
+    DECLARE_BITMAP(used, SHM_OBJ_MAX_PER_PAGE);
+};
 
-    /* Store base addresses */
-    _shm_base     = vbase;
-    _shm_pbase    = pbase;
-    _shm_nr_pages = nr_pages;
+/** Slabs with free objects, per size class. Protected by @_shm_lock. */
+static struct list_head _shm_slabs_partial[SHM_OBJ_CLASSES];
 
-    /* Initialize the mem semaphore. */
-    sema_init(&_shm_sem, 1);
+static inline unsigned int shm_obj_size(unsigned int class)
+{
+    return SHM_OBJ_MIN_SIZE << class;
+}
 
-    /* Create and insert original block. */
-    b = kmalloc(sizeof(pnc_shm_block_t), GFP_KERNEL);
-    if (b == NULL) {
-        return -ENOMEM;
+/**
+ * @brief SHM block exported as a dma-buf
+ *
+ * Block pages stay allocated as long as the dma-buf exists, even if block's
+ * owner releases it first.
+ */
+struct shm_export
+{
+    /* Node in @_shm_exports */
+    struct list_head node;
+    /* Exported block geometry */
+    unsigned int offset;
+    unsigned int nr_pages;
+    /* Set once block's owner released it: pages are freed with the dma-buf */
+    bool orphan;
+};
+
+#ifdef CONFIG_PROVENCORE_REE_DMABUF
+/** Exported blocks. Protected by @_shm_lock. */
+static LIST_HEAD(_shm_exports);
+
+/**
+ * @brief Find export overlapping a block
+ *
+ * Called with @_shm_lock held.
+ */
+static struct shm_export *shm_find_export(pnc_shm_block_t *b)
+{
+    struct shm_export *e;
+
+    list_for_each_entry(e, &_shm_exports, node) {
+        if (e->offset < b->offset + b->nr_pages &&
+            b->offset < e->offset + e->nr_pages) {
+            return e;
+        }
     }
+    return NULL;
+}
+#else
+static inline struct shm_export *shm_find_export(pnc_shm_block_t *b)
+{
+    return NULL;
+}
+#endif /* CONFIG_PROVENCORE_REE_DMABUF */
 
-    b->offset = REE_RESERVED_PAGES;
-    b->nr_pages = nr_pages - REE_RESERVED_PAGES;
-    b->free = 1;
-    b->next = NULL;
-    _blocks = b;
-    return 0;
+/**
+ * @brief SHM block mapped in userspace
+ *
+ * Geometry is the one of the block when mapped: mapped blocks can't shrink
+ * nor move, only grow. Block pages stay allocated as long as they are mapped,
+ * even if block's owner releases it first.
+ */
+struct pnc_shm_map
+{
+    /* Node in @_shm_maps */
+    struct list_head node;
+    /* Mapped block geometry */
+    unsigned int offset;
+    unsigned int nr_pages;
+    /* Num of vmas mapping block */
+    unsigned int refs;
+    /* Set once block's owner released it: pages are freed with last vma */
+    bool orphan;
+};
+
+/** Mapped blocks. Protected by @_shm_lock. */
+static LIST_HEAD(_shm_maps);
+
+/**
+ * @brief Find mapping overlapping a block
+ *
+ * Called with @_shm_lock held.
+ */
+static struct pnc_shm_map *shm_find_map(pnc_shm_block_t *b)
+{
+    struct pnc_shm_map *m;
+
+    list_for_each_entry(m, &_shm_maps, node) {
+        if (m->offset < b->offset + b->nr_pages &&
+            b->offset < m->offset + m->nr_pages) {
+            return m;
+        }
+    }
+    return NULL;
 }
 
-void pnc_shm_exit(void)
+/**
+ * @brief Get the region holding SHM page \p offset
+ * @return              Region, NULL if \p offset is not a SHM page
+ */
+static struct shm_region *shm_region_of(unsigned long offset)
 {
-    pnc_shm_block_t *b = _blocks, *n;
+    unsigned long id;
+    struct shm_region *r = &_shm_regions[0];
 
-    while (b != NULL) {
-        n = b->next;
-        kfree(b);
-        b = n;
+    if (offset < r->nr_pages) {
+        return r;
+    }
+    id = offset >> REE_SHM_REGION_SHIFT;
+    if (id == 0 || id >= SHM_MAX_REGIONS) {
+        return NULL;
+    }
+    r = &_shm_regions[id];
+    if (offset - r->offset >= r->nr_pages) {
+        return NULL;
     }
+    return r;
+}
 
-    _blocks = NULL;
+/**
+ * @brief Get slab descriptor slot of SHM page \p page
+ * @return              Slot, NULL if \p page is not a SHM page
+ */
+static struct shm_slab **shm_slab_slot(unsigned long page)
+{
+    struct shm_region *r = shm_region_of(page);
+
+    if (r == NULL) {
+        return NULL;
+    }
+    return &r->slab_pages[page - r->offset];
 }
 
-int pnc_shm_alloc(unsigned int nr_pages, pnc_shm_block_t **block)
+/**
+ * @brief Get kernel virtual address of a block, if already mapped
+ */
+static void *shm_block_mapped_vaddr(pnc_shm_block_t *b)
 {
-    pnc_shm_block_t *b = _blocks, *n;
-    int ret = 0;
+    if (b->offset + b->nr_pages <= _shm_mapped_pages) {
+        return (char *)_shm_base + ((unsigned long)b->offset << PAGE_SHIFT);
+    }
+    return READ_ONCE(b->vaddr);
+}
 
-    if (down_interruptible(&_shm_sem)) {
-        return -ERESTARTSYS;
+/**
+ * @brief Drop on demand kernel mapping of a block, if any
+ */
+static void shm_block_unmap(pnc_shm_block_t *b)
+{
+    if (b->vaddr != NULL) {
+        vunmap(b->vaddr);
+        b->vaddr = NULL;
     }
+}
 
-    while (b != NULL) {
-        n = b->next;
-        if (!b->free) {
-            b = n;
-            continue;
+/**
+ * @brief Allocate the allocator structures of region \p r
+ */
+static int shm_region_init(struct shm_region *r, unsigned int nr_pages)
+{
+    r->bitmap = kcalloc(BITS_TO_LONGS(nr_pages), sizeof(unsigned long),
+        GFP_KERNEL);
+    r->dirty = kcalloc(BITS_TO_LONGS(nr_pages), sizeof(unsigned long),
+        GFP_KERNEL);
+    r->slab_pages = kcalloc(nr_pages, sizeof(struct shm_slab *), GFP_KERNEL);
+    if (r->bitmap == NULL || r->dirty == NULL || r->slab_pages == NULL) {
+        kfree(r->bitmap);
+        kfree(r->dirty);
+        kfree(r->slab_pages);
+        r->bitmap = NULL;
+        r->dirty = NULL;
+        r->slab_pages = NULL;
+        return -ENOMEM;
+    }
+    r->nr_used = 0;
+    r->retiring = false;
+    return 0;
+}
+
+/**
+ * @brief Release the allocator structures of region \p r, and its slabs
+ */
+static void shm_region_exit(struct shm_region *r)
+{
+    unsigned int i;
+
+    if (r->slab_pages != NULL) {
+        for (i = 0; i < r->nr_pages; i++) {
+            if (r->slab_pages[i] != NULL) {
+                shm_block_unmap(&r->slab_pages[i]->block);
+                kfree(r->slab_pages[i]);
+            }
         }
-        /* Nice and all. */
-        if (b->nr_pages == nr_pages) {
-            goto found;
+        kfree(r->slab_pages);
+        r->slab_pages = NULL;
+    }
+    kfree(r->bitmap);
+    kfree(r->dirty);
+    r->bitmap = NULL;
+    r->dirty = NULL;
+}
+
+/**
+ * @brief Allocate physical memory backing a region added at runtime
+ * @param order         Region size order, in pages
+ * @return              First page, NULL on allocation failure
+ */
+static struct page *shm_region_alloc_pages(unsigned int order)
+{
+    struct page *page;
+#ifdef CONFIG_PROVENCORE_REE_CMA
+    unsigned long i;
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,19,0)
+    page = cma_alloc(dev_get_cma_area(NULL), 1UL << order, order, true);
+#elif LINUX_VERSION_CODE >= KERNEL_VERSION(4,15,0)
+    page = cma_alloc(dev_get_cma_area(NULL), 1UL << order, order,
+        GFP_KERNEL | __GFP_NOWARN);
+#else
+    page = cma_alloc(dev_get_cma_area(NULL), 1UL << order, order);
+#endif
+    if (page != NULL) {
+        for (i = 0; i < (1UL << order); i++) {
+            clear_highpage(page + i);
         }
-        /* Not large enough, but check next block. */
-        else if (b->nr_pages < nr_pages) {
-            if (n == NULL) {
+    }
+#else
+    page = alloc_pages(GFP_KERNEL | __GFP_ZERO | __GFP_NOWARN, order);
+    if (page != NULL) {
+        /* Pages are mapped to user space individually, see main.c */
+        split_page(page, order);
+    }
+#endif
+    return page;
+}
+
+/**
+ * @brief Release physical memory of a region added at runtime
+ */
+static void shm_region_free_pages(struct page *page, unsigned int nr_pages)
+{
+#ifdef CONFIG_PROVENCORE_REE_CMA
+    cma_release(dev_get_cma_area(NULL), page, nr_pages);
+#else
+    unsigned int i;
+
+    for (i = 0; i < nr_pages; i++) {
+        __free_page(page + i);
+    }
+#endif
+}
+
+/**
+ * @brief Announce region \p r to the secure monitor
+ * @return              - 0 on success
+ *                      - -EOPNOTSUPP if monitor refused the region
+ */
+static int shm_region_forward(struct shm_region *r)
+{
+    struct pnc_smc_params params;
+
+    memset(&params, 0, sizeof(struct pnc_smc_params));
+    params.a0 = SMC_ADD_SHAREDMEM;
+    params.a1 = r->pbase;
+    params.a2 = r->pbase >> 32;
+    params.a3 = r->nr_pages * PAGE_SIZE;
+    params.a4 = LINUX_SHARED_MEM_TAG;
+    params.a5 = r->offset;
+    pnc_sched_smc(&params);
+    if (params.a0 != 0) {
+        pr_warn("(%s) SHM region [%#.8x - %#.8x] refused (%d)\n", __func__,
+            r->offset, r->offset + r->nr_pages, (int)params.a0);
+        return -EOPNOTSUPP;
+    }
+    return 0;
+}
+
+/**
+ * @brief Check whether SHM regions can be added
+ */
+static bool shm_hotadd_supported(void)
+{
+    pnc_header_t *header = (pnc_header_t *)_shm_base;
+
+    if (SHM_MAX_REGIONS < 2 || READ_ONCE(_shm_hotadd_disabled) ||
+        !pnc_shm_ready()) {
+        return false;
+    }
+    return header->version >= 0x305;
+}
+
+/**
+ * @brief Zero SHM pages
+ *
+ * Called without @_shm_lock, on pages owned by the caller.
+ */
+static void shm_scrub_pages(unsigned long pfn, unsigned int nr_pages)
+{
+    unsigned int i;
+
+    for (i = 0; i < nr_pages; i++) {
+        clear_highpage(pfn_to_page(pfn + i));
+    }
+}
+
+/**
+ * @brief Mark pages [\p index, \p index + \p nr_pages) of region \p r used.
+ *
+ * Called with @_shm_lock held.
+ *
+ * @return true if any page is dirty: caller has to zero them
+ */
+static bool shm_region_claim(struct shm_region *r, unsigned long index,
+    unsigned int nr_pages)
+{
+    bool dirty;
+
+    bitmap_set(r->bitmap, index, nr_pages);
+    r->nr_used += nr_pages;
+    dirty = find_next_bit(r->dirty, index + nr_pages, index) <
+        index + nr_pages;
+    bitmap_clear(r->dirty, index, nr_pages);
+    return dirty;
+}
+
+/**
+ * @brief Mark pages [\p index, \p index + \p nr_pages) of region \p r free.
+ *
+ * Called with @_shm_lock held. An added region left empty is scheduled for
+ * removal.
+ */
+static void shm_region_put(struct shm_region *r, unsigned long index,
+    unsigned int nr_pages)
+{
+    bitmap_clear(r->bitmap, index, nr_pages);
+    r->nr_used -= nr_pages;
+    if (r != &_shm_regions[0] && r->nr_used == 0 && r->nr_mapped == 0) {
+        schedule_delayed_work(&_shm_retire_work, SHM_RETIRE_DELAY);
+    }
+}
+
+/**
+ * @brief Try to allocate \p nr_pages pages in region \p r.
+ *
+ * Called with @_shm_lock held.
+ *
+ * @param dirty     set if allocated pages have to be zeroed
+ */
+static int shm_region_alloc(struct shm_region *r, unsigned int nr_pages,
+    unsigned long align_mask, pnc_shm_block_t *b, bool *dirty)
+{
+    unsigned long index;
+
+    if (r->nr_pages == 0 || r->retiring ||
+        r->nr_pages - r->nr_used < nr_pages) {
+        return -ENOMEM;
+    }
+    /* First fit, aligned on physical page frame number */
+    index = bitmap_find_next_zero_area_off(r->bitmap, r->nr_pages, 0,
+        nr_pages, align_mask, (unsigned long)(r->pbase >> PAGE_SHIFT));
+    if (index >= r->nr_pages) {
+        return -ENOMEM;
+    }
+    *dirty = shm_region_claim(r, index, nr_pages);
+
+    b->offset = r->offset + index;
+    b->nr_pages = nr_pages;
+    b->vaddr = NULL;
+    return 0;
+}
+
+/**
+ * @brief Try to allocate \p nr_pages pages in any existing region.
+ */
+static int shm_try_alloc(unsigned int nr_pages, unsigned long align_mask,
+    pnc_shm_block_t *b, bool *dirty)
+{
+    unsigned long flags;
+    unsigned int i;
+    int ret = -ENOMEM;
+
+    spin_lock_irqsave(&_shm_lock, flags);
+    for (i = 0; i < SHM_MAX_REGIONS && ret != 0; i++) {
+        ret = shm_region_alloc(&_shm_regions[i], nr_pages, align_mask, b,
+            dirty);
+    }
+    spin_unlock_irqrestore(&_shm_lock, flags);
+    return ret;
+}
+
+/**
+ * @brief Give back pages [\p index, \p index + \p nr_pages) of region \p r.
+ *
+ * Called with @_shm_lock held. Pages are dirty until zeroed by the scrub
+ * worker.
+ */
+static void shm_region_release(struct shm_region *r, unsigned long index,
+    unsigned int nr_pages)
+{
+    bitmap_set(r->dirty, index, nr_pages);
+    shm_region_put(r, index, nr_pages);
+    queue_work(_shm_scrub_wq, &_shm_scrub_work);
+}
+
+/**
+ * @brief Zero dirty free pages, batch by batch.
+ */
+static void shm_scrub_work_handler(struct work_struct *work)
+{
+    struct shm_region *r;
+    unsigned long flags, index, end, pfn;
+    unsigned int id, nr_pages;
+
+    for (id = 0; id < SHM_MAX_REGIONS; id++) {
+        r = &_shm_regions[id];
+        for (;;) {
+            spin_lock_irqsave(&_shm_lock, flags);
+            if (r->nr_pages == 0 || r->retiring) {
+                spin_unlock_irqrestore(&_shm_lock, flags);
                 break;
             }
-            if (n->free) {
-                b->nr_pages += n->nr_pages;
-                b->next = n->next;
-                kfree(n);
-            } else {
-                b = n->next;
-                /* continue */
+            index = find_first_bit(r->dirty, r->nr_pages);
+            if (index >= r->nr_pages) {
+                spin_unlock_irqrestore(&_shm_lock, flags);
+                break;
             }
+            end = find_next_zero_bit(r->dirty,
+                min_t(unsigned long, r->nr_pages, index + SHM_SCRUB_BATCH),
+                index);
+            nr_pages = end - index;
+            /* Allocator skips pages while they are being zeroed */
+            shm_region_claim(r, index, nr_pages);
+            pfn = (unsigned long)(r->pbase >> PAGE_SHIFT) + index;
+            spin_unlock_irqrestore(&_shm_lock, flags);
+
+            shm_scrub_pages(pfn, nr_pages);
+
+            spin_lock_irqsave(&_shm_lock, flags);
+            shm_region_put(r, index, nr_pages);
+            spin_unlock_irqrestore(&_shm_lock, flags);
+            cond_resched();
+        }
+    }
+}
+
+/**
+ * @brief Add a SHM region and allocate a block of \p nr_pages pages from it.
+ *
+ * Region is at least 2^CONFIG_PROVENCORE_REE_SHM_REGION_ORDER pages, and
+ * naturally aligned on its size.
+ */
+static int shm_grow(unsigned int nr_pages, unsigned int align_order,
+    pnc_shm_block_t *b)
+{
+    unsigned long align_mask = (1UL << align_order) - 1;
+    struct shm_region *r = NULL;
+    struct page *page;
+    unsigned int order, id;
+    unsigned long flags;
+    bool dirty = false;
+    int ret;
+
+    if (!shm_hotadd_supported()) {
+        return -ENOMEM;
+    }
+
+    order = max_t(unsigned int, CONFIG_PROVENCORE_REE_SHM_REGION_ORDER,
+        order_base_2(nr_pages));
+    order = max(order, align_order);
+    if ((1U << order) > SHM_REGION_MAX_PAGES) {
+        return -ENOMEM;
+    }
+
+    mutex_lock(&_shm_regions_mutex);
+
+    /* Another allocator may have added a region in the meantime */
+    ret = shm_try_alloc(nr_pages, align_mask, b, &dirty);
+    if (ret == 0) {
+        goto end;
+    }
+    ret = -ENOMEM;
+
+    for (id = 1; id < SHM_MAX_REGIONS; id++) {
+        if (_shm_regions[id].nr_pages == 0) {
+            r = &_shm_regions[id];
+            break;
+        }
+    }
+    if (r == NULL) {
+        goto end;
+    }
+
+    page = shm_region_alloc_pages(order);
+    if (page == NULL) {
+        pr_warn("(%s) failed to allocate %u pages SHM region\n", __func__,
+            1U << order);
+        goto end;
+    }
+    if (shm_region_init(r, 1U << order) != 0) {
+        shm_region_free_pages(page, 1U << order);
+        goto end;
+    }
+
+    /* Not usable by allocator until secure monitor knows about it */
+    spin_lock_irqsave(&_shm_lock, flags);
+    r->retiring = true;
+    r->pbase = (uint64_t)page_to_pfn(page) << PAGE_SHIFT;
+    r->offset = id << REE_SHM_REGION_SHIFT;
+    r->nr_pages = 1U << order;
+    spin_unlock_irqrestore(&_shm_lock, flags);
+
+    if (shm_region_forward(r) != 0) {
+        /* Don't try again */
+        WRITE_ONCE(_shm_hotadd_disabled, true);
+        shm_region_exit(r);
+        spin_lock_irqsave(&_shm_lock, flags);
+        r->nr_pages = 0;
+        r->retiring = false;
+        spin_unlock_irqrestore(&_shm_lock, flags);
+        shm_region_free_pages(page, 1U << order);
+        goto end;
+    }
+    pr_info("(%s) added SHM region %u: %u pages at 0x%llx\n", __func__, id,
+        r->nr_pages, (unsigned long long)r->pbase);
+
+    /* Publish region, and take our block first: new pages are zeroed */
+    spin_lock_irqsave(&_shm_lock, flags);
+    r->retiring = false;
+    ret = shm_region_alloc(r, nr_pages, align_mask, b, &dirty);
+    spin_unlock_irqrestore(&_shm_lock, flags);
+
+end:
+    mutex_unlock(&_shm_regions_mutex);
+    if (ret == 0 && dirty) {
+        shm_scrub_pages(pnc_shm_pfn(b->offset), b->nr_pages);
+    }
+    return ret;
+}
+
+/**
+ * @brief Remove empty regions added at runtime.
+ */
+static void shm_retire_work_handler(struct work_struct *work)
+{
+    struct pnc_smc_params params;
+    struct shm_region *r;
+    unsigned long flags;
+    unsigned int id;
+
+    mutex_lock(&_shm_regions_mutex);
+    for (id = 1; id < SHM_MAX_REGIONS; id++) {
+        r = &_shm_regions[id];
+
+        spin_lock_irqsave(&_shm_lock, flags);
+        /* Dirty pages are zeroed first: rescheduled once done. Mapped pages
+         * are not given back: rescheduled once unmapped */
+        if (r->nr_pages == 0 || r->nr_used != 0 || r->nr_mapped != 0 ||
+            find_first_bit(r->dirty, r->nr_pages) < r->nr_pages) {
+            spin_unlock_irqrestore(&_shm_lock, flags);
+            continue;
         }
-        /* Too large, check if can do away without splitting. */
-        else if (n != NULL && n->free) {
-            n->nr_pages += b->nr_pages - nr_pages;
-            n->offset = b->offset + nr_pages;
-            b->nr_pages = nr_pages;
-            goto found;
+        r->retiring = true;
+        spin_unlock_irqrestore(&_shm_lock, flags);
+
+        memset(&params, 0, sizeof(struct pnc_smc_params));
+        params.a0 = SMC_REMOVE_SHAREDMEM;
+        params.a1 = r->offset;
+        params.a4 = LINUX_SHARED_MEM_TAG;
+        pnc_sched_smc(&params);
+        if (params.a0 != 0) {
+            /* Keep it, it is still usable */
+            pr_warn("(%s) SHM region %u removal refused (%d)\n", __func__, id,
+                (int)params.a0);
+            spin_lock_irqsave(&_shm_lock, flags);
+            r->retiring = false;
+            spin_unlock_irqrestore(&_shm_lock, flags);
+            continue;
+        }
+
+        shm_region_exit(r);
+        shm_region_free_pages(pfn_to_page(r->pbase >> PAGE_SHIFT),
+            r->nr_pages);
+        spin_lock_irqsave(&_shm_lock, flags);
+        r->nr_pages = 0;
+        r->retiring = false;
+        spin_unlock_irqrestore(&_shm_lock, flags);
+        pr_info("(%s) removed SHM region %u\n", __func__, id);
+    }
+    mutex_unlock(&_shm_regions_mutex);
+}
+
+int pnc_shm_init(void *vbase, uint64_t pbase, unsigned int nr_pages,
+    unsigned int mapped_pages)
+{
+    struct shm_region *r = &_shm_regions[0];
+    unsigned int i;
+    int ret;
+
+    /* Store base addresses */
+    _shm_base = vbase;
+    _shm_mapped_pages = mapped_pages;
+
+    _shm_scrub_wq = alloc_workqueue("pnc_shm_scrub", WQ_UNBOUND | WQ_SYSFS,
+        1);
+    if (_shm_scrub_wq == NULL) {
+        return -ENOMEM;
+    }
+
+    ret = shm_region_init(r, nr_pages);
+    if (ret != 0) {
+        destroy_workqueue(_shm_scrub_wq);
+        _shm_scrub_wq = NULL;
+        return ret;
+    }
+    r->pbase = pbase;
+    r->offset = 0;
+    r->nr_pages = nr_pages;
+    for (i = 0; i < SHM_OBJ_CLASSES; i++) {
+        INIT_LIST_HEAD(&_shm_slabs_partial[i]);
+    }
+
+    if (nr_pages > SHM_REGION_MAX_PAGES) {
+        /* Added regions offsets would overlap this one */
+        pr_info("(%s) SHM too large for additional regions\n", __func__);
+        _shm_hotadd_disabled = true;
+    }
+
+    /* REE header and rings are never allocated */
+    bitmap_set(r->bitmap, 0, REE_RESERVED_PAGES);
+    r->nr_used = REE_RESERVED_PAGES;
+#ifdef CONFIG_PROVENCORE_DTS_CONFIGURATION
+    /* Reserved memory content is unknown, allocated one is zeroed */
+    bitmap_set(r->dirty, REE_RESERVED_PAGES, nr_pages - REE_RESERVED_PAGES);
+    queue_work(_shm_scrub_wq, &_shm_scrub_work);
+#endif
+    return 0;
+}
+
+void pnc_shm_exit(void)
+{
+    unsigned int id;
+
+    if (_shm_scrub_wq != NULL) {
+        cancel_work_sync(&_shm_scrub_work);
+        destroy_workqueue(_shm_scrub_wq);
+        _shm_scrub_wq = NULL;
+    }
+    cancel_delayed_work_sync(&_shm_retire_work);
+    for (id = 0; id < SHM_MAX_REGIONS; id++) {
+        if (_shm_regions[id].nr_pages == 0) {
+            continue;
         }
-        /* Do split the block. */
-        else {
-            goto split;
+        shm_region_exit(&_shm_regions[id]);
+        if (id != 0) {
+            shm_region_free_pages(
+                pfn_to_page(_shm_regions[id].pbase >> PAGE_SHIFT),
+                _shm_regions[id].nr_pages);
         }
+        _shm_regions[id].nr_pages = 0;
     }
-    ret = -ENOMEM;
-    goto err;
-
-split:
-    n = kmalloc(sizeof(pnc_shm_block_t), GFP_KERNEL);
-    if (n == NULL) {
-        ret = -ENOMEM;
-        goto err;
-    }
-    n->next = b->next;
-    n->offset = b->offset + nr_pages;
-    n->nr_pages = b->nr_pages - nr_pages;
-    n->free = 1;
-    b->next = n;
-    b->nr_pages = nr_pages;
-found:
+}
+
+int pnc_shm_alloc_aligned(unsigned int nr_pages, unsigned int align_order,
+    pnc_shm_block_t *b)
+{
+    bool dirty = false;
+    int ret;
+
+    if (nr_pages == 0) {
+        return -EINVAL;
+    }
+
+    ret = shm_try_alloc(nr_pages, (1UL << align_order) - 1, b, &dirty);
+    if (ret != 0) {
+        ret = shm_grow(nr_pages, align_order, b);
+    }
+    if (ret != 0) {
+        return ret;
+    }
+    if (dirty) {
+        /* Scrub worker did not get there yet */
+        shm_scrub_pages(pnc_shm_pfn(b->offset), b->nr_pages);
+    }
+
     pr_debug("shm alloc range [%#.8x - %#.8x]\n", b->offset,
         b->offset + b->nr_pages);
-    b->free = 0;
-    *block = b;
-err:
-    up(&_shm_sem);
-    return ret;
+    return 0;
+}
+
+int pnc_shm_alloc(unsigned int nr_pages, pnc_shm_block_t *b)
+{
+    return pnc_shm_alloc_aligned(nr_pages, 0, b);
 }
 
-int pnc_shm_free(pnc_shm_block_t *b)
+unsigned long pnc_shm_pfn(unsigned int offset)
 {
-    if (b == NULL) {
+    struct shm_region *r = shm_region_of(offset);
+
+    if (r == NULL) {
         return 0;
     }
+    return (unsigned long)(r->pbase >> PAGE_SHIFT) + (offset - r->offset);
+}
+
+struct pnc_shm_map *pnc_shm_map_get(pnc_shm_block_t *b)
+{
+    struct pnc_shm_map *m, *new_map;
+    struct shm_region *r;
+    unsigned long flags;
+
+    if (b == NULL || b->nr_pages == 0) {
+        return ERR_PTR(-EINVAL);
+    }
+    new_map = kzalloc(sizeof(*new_map), GFP_KERNEL);
+    if (new_map == NULL) {
+        return ERR_PTR(-ENOMEM);
+    }
+
+    spin_lock_irqsave(&_shm_lock, flags);
+    m = shm_find_map(b);
+    if (m == NULL) {
+        m = new_map;
+        new_map = NULL;
+        list_add(&m->node, &_shm_maps);
+        r = shm_region_of(b->offset);
+        if (r != NULL) {
+            r->nr_mapped++;
+        }
+    }
+    /* Block may have grown since mapped */
+    m->offset = b->offset;
+    m->nr_pages = b->nr_pages;
+    m->refs++;
+    spin_unlock_irqrestore(&_shm_lock, flags);
+
+    kfree(new_map);
+    return m;
+}
+
+void pnc_shm_map_dup(struct pnc_shm_map *m)
+{
+    unsigned long flags;
+
+    spin_lock_irqsave(&_shm_lock, flags);
+    m->refs++;
+    spin_unlock_irqrestore(&_shm_lock, flags);
+}
+
+void pnc_shm_map_put(struct pnc_shm_map *m)
+{
+    pnc_shm_block_t b;
+    struct shm_export *e;
+    struct shm_region *r;
+    unsigned long flags;
+
+    spin_lock_irqsave(&_shm_lock, flags);
+    if (WARN_ON(m->refs == 0) || --m->refs != 0) {
+        spin_unlock_irqrestore(&_shm_lock, flags);
+        return;
+    }
+    list_del(&m->node);
+    r = shm_region_of(m->offset);
+    if (r != NULL && !WARN_ON(r->nr_mapped == 0)) {
+        r->nr_mapped--;
+        if (r != &_shm_regions[0] && r->nr_used == 0 && r->nr_mapped == 0) {
+            schedule_delayed_work(&_shm_retire_work, SHM_RETIRE_DELAY);
+        }
+    }
+    if (m->orphan && r != NULL) {
+        b.offset = m->offset;
+        b.nr_pages = m->nr_pages;
+        e = shm_find_export(&b);
+        if (e != NULL) {
+            /* Still used through dma-buf: released with it */
+            e->orphan = true;
+        } else {
+            shm_region_release(r, m->offset - r->offset, m->nr_pages);
+        }
+    }
+    spin_unlock_irqrestore(&_shm_lock, flags);
+    kfree(m);
+}
+
+bool pnc_shm_is_mapped(pnc_shm_block_t *b)
+{
+    unsigned long flags;
+    bool mapped;
+
+    if (b == NULL || b->nr_pages == 0) {
+        return false;
+    }
+    spin_lock_irqsave(&_shm_lock, flags);
+    mapped = shm_find_map(b) != NULL;
+    spin_unlock_irqrestore(&_shm_lock, flags);
+    return mapped;
+}
+
+void *pnc_shm_block_vaddr(pnc_shm_block_t *b)
+{
+    struct page **pages;
+    unsigned long pfn;
+    unsigned int i;
+    void *vaddr;
+
+    if (b == NULL || b->nr_pages == 0) {
+        return NULL;
+    }
+    vaddr = shm_block_mapped_vaddr(b);
+    if (vaddr != NULL) {
+        return vaddr;
+    }
+
+    pfn = pnc_shm_pfn(b->offset);
+    if (pfn == 0) {
+        return NULL;
+    }
+    pages = kmalloc_array(b->nr_pages, sizeof(struct page *), GFP_KERNEL);
+    if (pages == NULL) {
+        return NULL;
+    }
+    for (i = 0; i < b->nr_pages; i++) {
+        pages[i] = pfn_to_page(pfn + i);
+    }
+    vaddr = vmap(pages, b->nr_pages, VM_MAP, PAGE_KERNEL);
+    kfree(pages);
+    if (vaddr == NULL) {
+        pr_err("(%s) failed to map shm range [%#.8x - %#.8x]\n", __func__,
+            b->offset, b->offset + b->nr_pages);
+        return NULL;
+    }
+
+    /* Someone else may have mapped it in the meantime */
+    if (cmpxchg(&b->vaddr, NULL, vaddr) != NULL) {
+        vunmap(vaddr);
+        vaddr = b->vaddr;
+    }
+    return vaddr;
+}
+
+int pnc_shm_resize(pnc_shm_block_t *b, unsigned int nr_pages)
+{
+    struct shm_region *r = shm_region_of(b->offset);
+    unsigned long flags;
+    unsigned long index, end;
+    bool dirty = false;
+    int ret = 0;
+
+    if (nr_pages == 0 || r == NULL) {
+        return -EINVAL;
+    }
+    index = b->offset - r->offset;
+    end = index + nr_pages;
+
+    spin_lock_irqsave(&_shm_lock, flags);
+    if (shm_find_export(b) != NULL) {
+        /* dma-buf size can't change */
+        ret = -EBUSY;
+    } else if (nr_pages < b->nr_pages) {
+        shm_region_release(r, end, b->nr_pages - nr_pages);
+    } else if (nr_pages > b->nr_pages) {
+        if (end > r->nr_pages ||
+            find_next_bit(r->bitmap, end, index + b->nr_pages) < end) {
+            ret = -ENOMEM;
+        } else {
+            dirty = shm_region_claim(r, index + b->nr_pages,
+                nr_pages - b->nr_pages);
+        }
+    }
+    spin_unlock_irqrestore(&_shm_lock, flags);
+
+    if (dirty) {
+        shm_scrub_pages(pnc_shm_pfn(b->offset + b->nr_pages),
+            nr_pages - b->nr_pages);
+    }
+    if (ret == 0) {
+        /* Mapping no longer matches block geometry */
+        shm_block_unmap(b);
+        pr_debug("shm resize range [%#.8x - %#.8x] to %u pages\n", b->offset,
+            b->offset + b->nr_pages, nr_pages);
+        b->nr_pages = nr_pages;
+    }
+    return ret;
+}
+
+void pnc_shm_free(pnc_shm_block_t *b)
+{
+    struct pnc_shm_map *m;
+    struct shm_region *r;
+    struct shm_export *e;
+    unsigned long flags;
+
+    if (b == NULL || b->nr_pages == 0) {
+        return;
+    }
+    r = shm_region_of(b->offset);
+    if (r == NULL) {
+        pr_err("(%s) invalid shm range %#.8x\n", __func__, b->offset);
+        return;
+    }
 
     pr_debug("shm free range [%#.8x - %#.8x]\n", b->offset,
         b->offset + b->nr_pages);
 
-    if (down_interruptible(&_shm_sem)) {
-        return -ERESTARTSYS;
+    shm_block_unmap(b);
+
+    spin_lock_irqsave(&_shm_lock, flags);
+    m = shm_find_map(b);
+    e = shm_find_export(b);
+    if (m != NULL) {
+        /* Still mapped in userspace: released with last mapping */
+        m->offset = b->offset;
+        m->nr_pages = b->nr_pages;
+        m->orphan = true;
+    } else if (e != NULL) {
+        /* Still used through dma-buf: released with it */
+        e->orphan = true;
+    } else {
+        shm_region_release(r, b->offset - r->offset, b->nr_pages);
+    }
+    spin_unlock_irqrestore(&_shm_lock, flags);
+    b->nr_pages = 0;
+}
+
+#ifdef CONFIG_PROVENCORE_REE_DMABUF
+static struct sg_table *shm_dmabuf_map(struct dma_buf_attachment *attach,
+    enum dma_data_direction dir)
+{
+    struct shm_export *e = attach->dmabuf->priv;
+    struct sg_table *sgt;
+    int ret;
+
+    sgt = kzalloc(sizeof(*sgt), GFP_KERNEL);
+    if (sgt == NULL) {
+        return ERR_PTR(-ENOMEM);
+    }
+    ret = sg_alloc_table(sgt, 1, GFP_KERNEL);
+    if (ret != 0) {
+        kfree(sgt);
+        return ERR_PTR(ret);
+    }
+    /* SHM blocks are physically contiguous */
+    sg_set_page(sgt->sgl, pfn_to_page(pnc_shm_pfn(e->offset)),
+        e->nr_pages << PAGE_SHIFT, 0);
+    if (dma_map_sg(attach->dev, sgt->sgl, sgt->orig_nents, dir) == 0) {
+        sg_free_table(sgt);
+        kfree(sgt);
+        return ERR_PTR(-ENOMEM);
+    }
+    return sgt;
+}
+
+static void shm_dmabuf_unmap(struct dma_buf_attachment *attach,
+    struct sg_table *sgt, enum dma_data_direction dir)
+{
+    dma_unmap_sg(attach->dev, sgt->sgl, sgt->orig_nents, dir);
+    sg_free_table(sgt);
+    kfree(sgt);
+}
+
+static void shm_dmabuf_release(struct dma_buf *dmabuf)
+{
+    struct shm_export *e = dmabuf->priv;
+    struct shm_region *r = shm_region_of(e->offset);
+    pnc_shm_block_t b = { .offset = e->offset, .nr_pages = e->nr_pages };
+    struct pnc_shm_map *m;
+    unsigned long flags;
+
+    spin_lock_irqsave(&_shm_lock, flags);
+    list_del(&e->node);
+    m = shm_find_map(&b);
+    if (e->orphan && m != NULL) {
+        /* Still mapped in userspace: released with last mapping */
+        m->orphan = true;
+    } else if (e->orphan && r != NULL) {
+        shm_region_release(r, e->offset - r->offset, e->nr_pages);
+    }
+    spin_unlock_irqrestore(&_shm_lock, flags);
+    pr_debug("shm dma-buf released [%#.8x - %#.8x]\n", e->offset,
+        e->offset + e->nr_pages);
+    kfree(e);
+}
+
+static int shm_dmabuf_mmap(struct dma_buf *dmabuf, struct vm_area_struct *vma)
+{
+    struct shm_export *e = dmabuf->priv;
+    unsigned long nr_pages = (vma->vm_end - vma->vm_start) >> PAGE_SHIFT;
+    unsigned long i, pfn;
+    int r;
+
+    if (vma->vm_pgoff >= e->nr_pages ||
+        nr_pages > e->nr_pages - vma->vm_pgoff) {
+        return -EINVAL;
+    }
+    vma->vm_flags |= VM_DONTEXPAND | VM_DONTDUMP;
+
+    pfn = pnc_shm_pfn(e->offset) + vma->vm_pgoff;
+    for (i = 0; i < nr_pages; i++, pfn++) {
+        r = vm_insert_page(vma, vma->vm_start + i * PAGE_SIZE,
+            pfn_to_page(pfn));
+        if (r != 0) {
+            return r;
+        }
+    }
+    return 0;
+}
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5,6,0)
+/* Page mapping ops are mandatory for older exporters */
+static void *shm_dmabuf_kmap(struct dma_buf *dmabuf, unsigned long pgnum)
+{
+    struct shm_export *e = dmabuf->priv;
+
+    if (pgnum >= e->nr_pages) {
+        return NULL;
+    }
+    return kmap(pfn_to_page(pnc_shm_pfn(e->offset) + pgnum));
+}
+
+static void shm_dmabuf_kunmap(struct dma_buf *dmabuf, unsigned long pgnum,
+    void *vaddr)
+{
+    struct shm_export *e = dmabuf->priv;
+
+    kunmap(pfn_to_page(pnc_shm_pfn(e->offset) + pgnum));
+}
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(4,19,0)
+static void *shm_dmabuf_kmap_atomic(struct dma_buf *dmabuf,
+    unsigned long pgnum)
+{
+    struct shm_export *e = dmabuf->priv;
+
+    if (pgnum >= e->nr_pages) {
+        return NULL;
+    }
+    return kmap_atomic(pfn_to_page(pnc_shm_pfn(e->offset) + pgnum));
+}
+
+static void shm_dmabuf_kunmap_atomic(struct dma_buf *dmabuf,
+    unsigned long pgnum, void *vaddr)
+{
+    kunmap_atomic(vaddr);
+}
+#endif
+#endif /* < 5.6 */
+
+static const struct dma_buf_ops shm_dmabuf_ops = {
+    .map_dma_buf = shm_dmabuf_map,
+    .unmap_dma_buf = shm_dmabuf_unmap,
+    .release = shm_dmabuf_release,
+    .mmap = shm_dmabuf_mmap,
+#if LINUX_VERSION_CODE < KERNEL_VERSION(4,12,0)
+    .kmap = shm_dmabuf_kmap,
+    .kunmap = shm_dmabuf_kunmap,
+    .kmap_atomic = shm_dmabuf_kmap_atomic,
+    .kunmap_atomic = shm_dmabuf_kunmap_atomic,
+#elif LINUX_VERSION_CODE < KERNEL_VERSION(4,19,0)
+    .map = shm_dmabuf_kmap,
+    .unmap = shm_dmabuf_kunmap,
+    .map_atomic = shm_dmabuf_kmap_atomic,
+    .unmap_atomic = shm_dmabuf_kunmap_atomic,
+#elif LINUX_VERSION_CODE < KERNEL_VERSION(5,6,0)
+    .map = shm_dmabuf_kmap,
+    .unmap = shm_dmabuf_kunmap,
+#endif
+};
+
+struct dma_buf *pnc_shm_export_dmabuf(pnc_shm_block_t *b, int flags)
+{
+    DEFINE_DMA_BUF_EXPORT_INFO(exp_info);
+    struct shm_export *e;
+    struct dma_buf *dmabuf;
+    unsigned long lock_flags;
+
+    if (b == NULL || b->nr_pages == 0) {
+        return ERR_PTR(-EINVAL);
     }
-    b->free = 1;
-    up(&_shm_sem);
+    e = kzalloc(sizeof(*e), GFP_KERNEL);
+    if (e == NULL) {
+        return ERR_PTR(-ENOMEM);
+    }
+    e->offset = b->offset;
+    e->nr_pages = b->nr_pages;
+
+    spin_lock_irqsave(&_shm_lock, lock_flags);
+    if (shm_find_export(b) != NULL) {
+        spin_unlock_irqrestore(&_shm_lock, lock_flags);
+        kfree(e);
+        return ERR_PTR(-EBUSY);
+    }
+    list_add(&e->node, &_shm_exports);
+    spin_unlock_irqrestore(&_shm_lock, lock_flags);
+
+    exp_info.ops = &shm_dmabuf_ops;
+    exp_info.size = (size_t)e->nr_pages << PAGE_SHIFT;
+    exp_info.flags = flags;
+    exp_info.priv = e;
+    dmabuf = dma_buf_export(&exp_info);
+    if (IS_ERR(dmabuf)) {
+        spin_lock_irqsave(&_shm_lock, lock_flags);
+        list_del(&e->node);
+        spin_unlock_irqrestore(&_shm_lock, lock_flags);
+        kfree(e);
+        return dmabuf;
+    }
+    pr_debug("shm dma-buf exported [%#.8x - %#.8x]\n", e->offset,
+        e->offset + e->nr_pages);
+    return dmabuf;
+}
+#endif /* CONFIG_PROVENCORE_REE_DMABUF */
+
+bool pnc_shm_is_exported(pnc_shm_block_t *b)
+{
+    unsigned long flags;
+    bool exported;
+
+    if (b == NULL || b->nr_pages == 0) {
+        return false;
+    }
+    spin_lock_irqsave(&_shm_lock, flags);
+    exported = shm_find_export(b) != NULL;
+    spin_unlock_irqrestore(&_shm_lock, flags);
+    return exported;
+}
+
+int pnc_shm_obj_alloc(size_t size, unsigned long *offset)
+{
+    struct shm_slab *slab, *new_slab = NULL;
+    unsigned int class, nr_objs, index;
+    unsigned long flags;
+    void *vaddr;
+    int ret;
+
+    if (size == 0 || size > shm_obj_size(SHM_OBJ_CLASSES - 1)) {
+        return -EINVAL;
+    }
+    for (class = 0; shm_obj_size(class) < size; class++)
+        ;
+    nr_objs = PAGE_SIZE / shm_obj_size(class);
+
+    spin_lock_irqsave(&_shm_lock, flags);
+    while (list_empty(&_shm_slabs_partial[class])) {
+        if (new_slab != NULL) {
+            /* Install new slab page */
+            list_add(&new_slab->node, &_shm_slabs_partial[class]);
+            *shm_slab_slot(new_slab->block.offset) = new_slab;
+            new_slab = NULL;
+            break;
+        }
+        /* No free object: get a new slab page, out of the lock */
+        spin_unlock_irqrestore(&_shm_lock, flags);
+        new_slab = kzalloc(sizeof(*new_slab), GFP_KERNEL);
+        if (new_slab == NULL) {
+            return -ENOMEM;
+        }
+        ret = pnc_shm_alloc(1, &new_slab->block);
+        if (ret != 0) {
+            kfree(new_slab);
+            return ret;
+        }
+        /* Map slab page once for all its objects */
+        if (pnc_shm_block_vaddr(&new_slab->block) == NULL) {
+            pnc_shm_free(&new_slab->block);
+            kfree(new_slab);
+            return -ENOMEM;
+        }
+        new_slab->class = class;
+        new_slab->nr_free = nr_objs;
+        spin_lock_irqsave(&_shm_lock, flags);
+    }
+
+    slab = list_first_entry(&_shm_slabs_partial[class], struct shm_slab, node);
+    index = find_first_zero_bit(slab->used, nr_objs);
+    __set_bit(index, slab->used);
+    if (--slab->nr_free == 0) {
+        list_del_init(&slab->node);
+    }
+    *offset = ((unsigned long)slab->block.offset << PAGE_SHIFT) +
+        index * shm_obj_size(class);
+    vaddr = (char *)shm_block_mapped_vaddr(&slab->block) +
+        index * shm_obj_size(class);
+    spin_unlock_irqrestore(&_shm_lock, flags);
+
+    if (new_slab != NULL) {
+        /* Someone else installed a slab page in the meantime */
+        pnc_shm_free(&new_slab->block);
+        kfree(new_slab);
+    }
+
+    memset(vaddr, 0, shm_obj_size(class));
+    pr_debug("shm alloc object %#.8lx (%u bytes)\n", *offset,
+        shm_obj_size(class));
+    return 0;
+}
+
+int pnc_shm_obj_free(unsigned long offset)
+{
+    struct shm_slab *slab, **slot;
+    unsigned int index, nr_objs;
+    unsigned long flags;
+
+    spin_lock_irqsave(&_shm_lock, flags);
+    slot = shm_slab_slot(offset >> PAGE_SHIFT);
+    slab = (slot != NULL) ? *slot : NULL;
+    if (slab == NULL || (offset & ~PAGE_MASK) % shm_obj_size(slab->class)) {
+        spin_unlock_irqrestore(&_shm_lock, flags);
+        return -EINVAL;
+    }
+    index = (offset & ~PAGE_MASK) / shm_obj_size(slab->class);
+    if (!__test_and_clear_bit(index, slab->used)) {
+        spin_unlock_irqrestore(&_shm_lock, flags);
+        return -EINVAL;
+    }
+
+    nr_objs = PAGE_SIZE / shm_obj_size(slab->class);
+    if (++slab->nr_free == 1) {
+        list_add(&slab->node, &_shm_slabs_partial[slab->class]);
+    }
+    if (slab->nr_free < nr_objs) {
+        spin_unlock_irqrestore(&_shm_lock, flags);
+        return 0;
+    }
+
+    /* Slab page is empty: give it back to page allocator */
+    list_del(&slab->node);
+    *slot = NULL;
+    spin_unlock_irqrestore(&_shm_lock, flags);
+    pnc_shm_free(&slab->block);
+    kfree(slab);
     return 0;
 }
 
+void *pnc_shm_obj_vaddr(unsigned long offset)
+{
+    struct shm_slab *slab, **slot;
+    unsigned long flags;
+    void *vaddr = NULL;
+
+    spin_lock_irqsave(&_shm_lock, flags);
+    slot = shm_slab_slot(offset >> PAGE_SHIFT);
+    slab = (slot != NULL) ? *slot : NULL;
+    if (slab != NULL) {
+        vaddr = (char *)shm_block_mapped_vaddr(&slab->block) +
+            (offset & ~PAGE_MASK);
+    }
+    spin_unlock_irqrestore(&_shm_lock, flags);
+    return vaddr;
+}
+
 _Bool pnc_shm_ready(void)
 {
     pnc_header_t *header = (pnc_header_t *)_shm_base;
@@ -198,11 +1436,23 @@ void pnc_shm_init_header(void)
 void pnc_shm_forward(void)
 {
     struct pnc_smc_params params;
+    struct shm_region *r = &_shm_regions[0];
+    unsigned int id;
 
+    mutex_lock(&_shm_regions_mutex);
     params.a0 = SMC_CONFIG_SHAREDMEM;
-    params.a1 = _shm_pbase;
-    params.a2 = _shm_pbase >> 32;
-    params.a3 = _shm_nr_pages * PAGE_SIZE;
+    params.a1 = r->pbase;
+    params.a2 = r->pbase >> 32;
+    params.a3 = r->nr_pages * PAGE_SIZE;
     params.a4 = LINUX_SHARED_MEM_TAG;
     pnc_sched_smc(&params);
+
+    /* Added regions are announced again, e.g after S world restart */
+    for (id = 1; id < SHM_MAX_REGIONS; id++) {
+        r = &_shm_regions[id];
+        if (r->nr_pages != 0 && !r->retiring) {
+            shm_region_forward(r);
+        }
+    }
+    mutex_unlock(&_shm_regions_mutex);
 }
@@ -16,31 +16,38 @@
 
 /**
  * @brief Represent a page range in the shared memory area.
+ *
+ * Storage is owned by allocator's caller: allocator only tracks page usage.
  */
 typedef struct pnc_shm_block
 {
-    /* Availability of the block */
-    _Bool free;
     /* Offset of the first page in the shared memory area. */
     unsigned int offset;
     /* Block size in pages. */
     unsigned int nr_pages;
-    /* Next block in the list. */
-    struct pnc_shm_block *next;
+    /* Kernel mapping of the block, if mapped on demand. */
+    void *vaddr;
 } pnc_shm_block_t;
 
 /**
  * @brief Initialise the structures used by the block allocator.
- *   The list \ref _blocks is created with one initial block representing the
- *   full range of available pages.
+ *   The given memory is SHM region 0, with REE reserved pages marked as used.
+ *   Further regions are added when allocator runs out of pages, if secure
+ *   world supports it.
+ *
+ * Only the first \p mapped_pages pages, at least REE reserved ones, are
+ * expected to be mapped at \p vbase. Blocks allocated beyond are mapped on
+ * demand by \ref pnc_shm_block_vaddr.
  *
  * @param vbase         Virtual base addr of contiguous allocated memory
  * @param pbase         Physical base addr of contiguous allocated memory
  * @param nr_pages      Number of allocated pages
+ * @param mapped_pages  Number of pages mapped at \p vbase
  * @return              - 0 on success
  *                      - -ENOMEM on internal allocation failure
  */
-int pnc_shm_init(void *vbase, uint64_t pbase, unsigned int nr_pages);
+int pnc_shm_init(void *vbase, uint64_t pbase, unsigned int nr_pages,
+    unsigned int mapped_pages);
 
 /**
  * @brief Destroy the structures used by the block allocator.
@@ -49,21 +56,172 @@ void pnc_shm_exit(void);
 
 /**
  * @brief Allocate a block of \p nr_pages pages.
+ *
+ * Block is physically contiguous and lies in a single SHM region. A new region
+ * is added if none has enough free pages left. Block content is zeroed: freed
+ * pages are zeroed in background, or on allocation if not done yet.
+ *
  * @param nr_pages      Requested number of pages
- * @param block         Pointer to the allocated block
- * @return              - -ERESTARTSYS if the lock could not be acquired
+ * @param b             Block descriptor updated with allocated range
+ * @return              - -EINVAL if \p nr_pages is 0
  *                      - -ENOMEM on allocation failure
  *                      - 0 on success
  */
-int pnc_shm_alloc(unsigned int nr_pages, pnc_shm_block_t **b);
+int pnc_shm_alloc(unsigned int nr_pages, pnc_shm_block_t *b);
+
+/**
+ * @brief Allocate a block of \p nr_pages pages, physically aligned on
+ *  2^\p align_order pages.
+ * @param nr_pages      Requested number of pages
+ * @param align_order   Alignment order, in pages
+ * @param b             Block descriptor updated with allocated range
+ * @return              - -EINVAL if \p nr_pages is 0
+ *                      - -ENOMEM on allocation failure
+ *                      - 0 on success
+ */
+int pnc_shm_alloc_aligned(unsigned int nr_pages, unsigned int align_order,
+    pnc_shm_block_t *b);
+
+/**
+ * @brief Get page frame number of SHM page \p offset.
+ * @param offset        Page offset in SHM
+ * @return              Page frame number, 0 if \p offset is not a SHM page
+ */
+unsigned long pnc_shm_pfn(unsigned int offset);
+
+/** Userspace mappings of a SHM block */
+struct pnc_shm_map;
+
+/**
+ * @brief Count a userspace mapping of the shared memory block \p b.
+ *
+ * All mappings of a block share a single handle, which keeps block geometry:
+ * it is released with \ref pnc_shm_map_put, whatever happened to \p b since.
+ * A region added at runtime is not removed while any of its blocks is mapped.
+ *
+ * @param b             Mapped memory block
+ * @return              Mapping handle, or ERR_PTR:
+ *                      - -EINVAL if \p b is not allocated
+ *                      - -ENOMEM on allocation failure
+ */
+struct pnc_shm_map *pnc_shm_map_get(pnc_shm_block_t *b);
+
+/**
+ * @brief Count one more userspace mapping of an already mapped block, e.g.
+ *  when its mapping is duplicated or split.
+ * @param m             Mapping handle
+ */
+void pnc_shm_map_dup(struct pnc_shm_map *m);
+
+/**
+ * @brief Count one less userspace mapping of a block. Handle is released with
+ *  the last one.
+ * @param m             Mapping handle
+ */
+void pnc_shm_map_put(struct pnc_shm_map *m);
+
+/**
+ * @brief Check whether any page of the shared memory block \p b is mapped in
+ *  userspace.
+ * @param b             Memory block
+ */
+bool pnc_shm_is_mapped(pnc_shm_block_t *b);
+
+/**
+ * @brief Get kernel virtual address of the shared memory block \p b.
+ *
+ * Block is mapped on first call if not part of SHM mapped at init. Mapping
+ * stays valid until block is resized or released.
+ *
+ * @param b             Memory block
+ * @return              Virtual address, NULL on mapping failure
+ */
+void *pnc_shm_block_vaddr(pnc_shm_block_t *b);
+
+/**
+ * @brief Resize the shared memory block \p b in place.
+ *
+ * Shrinking always succeeds. Growing only succeeds if pages following the
+ * block are free: added pages are zeroed. Any previous
+ * \ref pnc_shm_block_vaddr address is invalid afterwards.
+ *
+ * @param b             Memory block to be resized
+ * @param nr_pages      New number of pages
+ * @return              - -EINVAL if \p nr_pages is 0
+ *                      - -EBUSY if block is exported as a dma-buf: its size
+ *                        can't change
+ *                      - -ENOMEM if block can't grow in place
+ *                      - 0 on success
+ */
+int pnc_shm_resize(pnc_shm_block_t *b, unsigned int nr_pages);
 
 /**
  * @brief Release the shared memory block \p b.
+ *
+ * Pages are immediately available for any next allocation, merged with any
+ * free neighbour, unless still mapped in userspace or exported as a dma-buf:
+ * they are released with the last mapping or the dma-buf then. A region added
+ * at runtime is removed some time after its last block was released.
+ *
  * @param b             Memory block to be released
- * @return              - -ERESTARTSYS if the lock could not be acquired
+ */
+void pnc_shm_free(pnc_shm_block_t *b);
+
+#ifdef CONFIG_PROVENCORE_REE_DMABUF
+struct dma_buf;
+
+/**
+ * @brief Export the shared memory block \p b as a dma-buf.
+ *
+ * Block pages stay allocated until the dma-buf is released, even if \p b is
+ * released first. An exported block can't be resized, nor exported twice.
+ *
+ * @param b             Memory block
+ * @param flags         dma-buf file flags (O_RDWR, O_CLOEXEC...)
+ * @return              dma-buf, or ERR_PTR:
+ *                      - -EINVAL if \p b is not allocated
+ *                      - -EBUSY if \p b is already exported
+ *                      - -ENOMEM on allocation failure
+ */
+struct dma_buf *pnc_shm_export_dmabuf(pnc_shm_block_t *b, int flags);
+#endif /* CONFIG_PROVENCORE_REE_DMABUF */
+
+/**
+ * @brief Check whether any page of the shared memory block \p b is exported
+ *  as a dma-buf.
+ * @param b             Memory block
+ */
+bool pnc_shm_is_exported(pnc_shm_block_t *b);
+
+/**
+ * @brief Allocate a zeroed sub-page object of at least \p size bytes.
+ *
+ * Objects are carved out of SHM pages dedicated to their size class (powers of
+ * two from 64 bytes up to half a page), so that small buffers don't each use a
+ * whole page.
+ *
+ * @param size          Requested size in bytes
+ * @param offset        Updated with object's byte offset in SHM
+ * @return              - -EINVAL if \p size is 0 or larger than half a page
+ *                      - -ENOMEM on allocation failure
+ *                      - 0 on success
+ */
+int pnc_shm_obj_alloc(size_t size, unsigned long *offset);
+
+/**
+ * @brief Release a sub-page object.
+ * @param offset        Object's byte offset in SHM
+ * @return              - -EINVAL if \p offset is not an allocated object
  *                      - 0 on success
  */
-int pnc_shm_free(pnc_shm_block_t *b);
+int pnc_shm_obj_free(unsigned long offset);
+
+/**
+ * @brief Get kernel virtual address of a sub-page object.
+ * @param offset        Object's byte offset in SHM
+ * @return              Virtual address, NULL if \p offset is not in a slab page
+ */
+void *pnc_shm_obj_vaddr(unsigned long offset);
 
 /**
  * @brief Check whether Secure world finalized SHM initialization.
@@ -64,6 +64,12 @@ struct pnc_smc_params {
 
 #define SMC_CONFIG_SHAREDMEM \
     SMC_FUNC_ID(SMC_32BIT, SMC_FASTCALL, ARM_SMCCC_OWNER_PNC, 3)
+
+#define SMC_ADD_SHAREDMEM \
+    SMC_FUNC_ID(SMC_32BIT, SMC_FASTCALL, ARM_SMCCC_OWNER_PNC, 5)
+
+#define SMC_REMOVE_SHAREDMEM \
+    SMC_FUNC_ID(SMC_32BIT, SMC_FASTCALL, ARM_SMCCC_OWNER_PNC, 6)
 #else
 #define SMC_ACTION_FROM_NS	\
 	ARM_SMCCC_CALL_VAL(ARM_SMCCC_FAST_CALL, ARM_SMCCC_SMC_32, \
@@ -72,6 +78,14 @@ struct pnc_smc_params {
 #define SMC_CONFIG_SHAREDMEM	\
 	ARM_SMCCC_CALL_VAL(ARM_SMCCC_FAST_CALL, ARM_SMCCC_SMC_32, \
 		ARM_SMCCC_OWNER_PNC, 3)
+
+#define SMC_ADD_SHAREDMEM	\
+	ARM_SMCCC_CALL_VAL(ARM_SMCCC_FAST_CALL, ARM_SMCCC_SMC_32, \
+		ARM_SMCCC_OWNER_PNC, 5)
+
+#define SMC_REMOVE_SHAREDMEM	\
+	ARM_SMCCC_CALL_VAL(ARM_SMCCC_FAST_CALL, ARM_SMCCC_SMC_32, \
+		ARM_SMCCC_OWNER_PNC, 6)
 #endif
 
 /**
@@ -39,11 +39,41 @@ typedef struct shdev_ops {
 #ifdef CONFIG_PROVENCORE_MMC_USE_RPMB
     int (*rpmb)(shdev_desc_t *desc_ptr);
 #endif /* CONFIG_PROVENCORE_MMC_USE_RPMB */
+
+    int (*flush)(shdev_desc_t *desc_ptr);
+
+    /* Tell whether S held device long enough for its lease not to be
+     * renewed. Optional. */
+    bool (*hold_expired)(void);
+
+    /* Release resources kept across operations, called at module exit */
+    void (*release)(void);
 } shdev_ops_t;
 
+/* Shared devices monitor functions */
+int shdev_send_signal(uint32_t bits);
+
+#ifdef CONFIG_PROVENCORE_MMC_REMOTE_HOST
+/* Get MMC device resumed for a remote operation: a lease in its grace period
+ * is ended, -EBUSY is returned while S holds the device */
+int shdev_mmc_host_get(void);
+#endif /* CONFIG_PROVENCORE_MMC_REMOTE_HOST */
+
 /* Shared MMC public functions */
 shdev_ops_t *mmcblk_init(void);
 
+#ifdef CONFIG_PROVENCORE_MMC_REMOTE_HOST
+/* Reset MMC I/O \p rings, using data buffer of MMC descriptor \p desc_ptr.
+ * Rings are left disabled if MMC device can't be opened. */
+void mmcblk_io_setup(shdev_mmc_rings_t *rings, shdev_desc_t *desc_ptr);
+
+/* Handle new requests in MMC I/O submission ring */
+void mmcblk_io_kick(void);
+
+/* Disable MMC I/O rings and wait for in flight requests */
+void mmcblk_io_stop(void);
+#endif /* CONFIG_PROVENCORE_MMC_REMOTE_HOST */
+
 /* Shared ENET public functions */
 shdev_ops_t *enetdev_init(void);
 
@@ -35,6 +35,11 @@
 
 static int _mmc_block_minor = -1;
 
+#ifdef CONFIG_PROVENCORE_MMC_REMOTE_HOST
+static int mmcblk_merge_sync(loff_t pos, size_t length);
+static void mmcblk_merge_drain(void);
+#endif
+
 static struct block_device *_shdev_mmc_bdev = NULL;
 
 extern char *_shdev_shm_addr;
@@ -178,6 +183,542 @@ static void mmcblk_pm_runtime_enable(void)
     pm_runtime_enable(dev);
 }
 
+#ifdef CONFIG_PROVENCORE_MMC_CACHE
+#ifdef CONFIG_PROVENCORE_MMC_PARTITION_SHARING
+#error "Remote MMC cache is useless while Linux writes during S reads"
+#endif
+#include <linux/atomic.h>
+#include <linux/hashtable.h>
+#include <linux/list.h>
+#include <linux/moduleparam.h>
+#include <linux/mutex.h>
+#include <linux/version.h>
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5,8,0)
+#include <linux/part_stat.h>
+#endif
+
+#ifndef CONFIG_PROVENCORE_MMC_CACHE_BLOCKS
+#define CONFIG_PROVENCORE_MMC_CACHE_BLOCKS 256
+#endif
+
+/* Block cache for S reads ------------------------------------------------- */
+
+/** Cached PAGE_SIZE block of the user partition */
+struct mmcblk_cache_entry {
+    /* Node in cache hash table */
+    struct hlist_node hash;
+    /* Node in LRU list */
+    struct list_head lru;
+    /* Block index in partition */
+    pgoff_t index;
+    /* Block content */
+    struct page *page;
+};
+
+/** Block cache, bounded to CONFIG_PROVENCORE_MMC_CACHE_BLOCKS blocks */
+static struct {
+    struct mutex lock;
+    DECLARE_HASHTABLE(table, 8);
+    /* Entries, most recently used first */
+    struct list_head lru;
+    unsigned int nr_entries;
+    /* Incremented on each invalidation: reads started before one don't fill
+     * the cache */
+    unsigned long gen;
+    /* Sectors written to device by Linux when last checked, if valid */
+    unsigned long linux_sectors;
+    bool linux_valid;
+} _mmc_cache = {
+    .lock = __MUTEX_INITIALIZER(_mmc_cache.lock),
+    .lru = LIST_HEAD_INIT(_mmc_cache.lru),
+};
+
+/** S writes sent to device and not ended yet */
+static atomic_t _mmc_cache_writes = ATOMIC_INIT(0);
+/** Incremented each time a S write is sent to device */
+static atomic_t _mmc_cache_write_seq = ATOMIC_INIT(0);
+/** Sectors of ended S writes */
+static atomic_long_t _mmc_cache_s_sectors = ATOMIC_LONG_INIT(0);
+
+static unsigned long _mmc_cache_hits;
+module_param_named(mmc_cache_hits, _mmc_cache_hits, ulong, S_IRUGO);
+MODULE_PARM_DESC(mmc_cache_hits, "S reads served by MMC block cache");
+
+static unsigned long _mmc_cache_misses;
+module_param_named(mmc_cache_misses, _mmc_cache_misses, ulong, S_IRUGO);
+MODULE_PARM_DESC(mmc_cache_misses, "S reads sent to MMC device");
+
+static struct mmcblk_cache_entry *mmcblk_cache_find(pgoff_t index)
+{
+    struct mmcblk_cache_entry *e;
+
+    hash_for_each_possible(_mmc_cache.table, e, hash, index) {
+        if (e->index == index) {
+            return e;
+        }
+    }
+    return NULL;
+}
+
+static void mmcblk_cache_remove(struct mmcblk_cache_entry *e)
+{
+    hash_del(&e->hash);
+    list_del(&e->lru);
+    __free_page(e->page);
+    kfree(e);
+    _mmc_cache.nr_entries--;
+}
+
+/**
+ * @brief Copy blocks of the cache between \p data and \p page_data, for the
+ * part of block \p index within [\p pos, \p pos + \p length).
+ */
+static void mmcblk_cache_copy(uint8_t *data, void *page_data, pgoff_t index,
+    loff_t pos, size_t length, bool to_cache)
+{
+    loff_t start = max_t(loff_t, pos, (loff_t)index << PAGE_SHIFT);
+    loff_t end = min_t(loff_t, pos + length, (loff_t)(index + 1) << PAGE_SHIFT);
+    size_t offset = start & (PAGE_SIZE - 1);
+
+    if (to_cache) {
+        memcpy(page_data + offset, data + (start - pos), end - start);
+    } else {
+        memcpy(data + (start - pos), page_data + offset, end - start);
+    }
+}
+
+/**
+ * @brief Num of sectors written or discarded on \p bdev so far, by Linux and
+ * S.
+ */
+static unsigned long mmcblk_cache_written(struct block_device *bdev)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5,11,0)
+    struct block_device *part = bdev;
+#else
+    struct hd_struct *part = bdev->bd_part;
+#endif
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,19,0)
+    return part_stat_read(part, sectors[STAT_WRITE]) +
+        part_stat_read(part, sectors[STAT_DISCARD]);
+#else
+    return part_stat_read(part, sectors[WRITE]);
+#endif
+}
+
+/**
+ * @brief Drop all cached blocks. Called with cache lock held.
+ */
+static void mmcblk_cache_clear_locked(void)
+{
+    struct mmcblk_cache_entry *e, *next;
+
+    _mmc_cache.gen++;
+    list_for_each_entry_safe(e, next, &_mmc_cache.lru, lru) {
+        mmcblk_cache_remove(e);
+    }
+}
+
+/**
+ * @brief Drop the whole cache if Linux wrote to \p bdev since last check.
+ *
+ * Linux writes are device writes not made by S. Device stats account a write
+ * before it ends, S count once it ended: count is only exact if no S write
+ * was in flight meanwhile, cache is dropped otherwise. Called with cache lock
+ * held.
+ */
+static void mmcblk_cache_check_locked(struct block_device *bdev)
+{
+    int seq = atomic_read(&_mmc_cache_write_seq);
+    unsigned long linux_sectors;
+    bool exact;
+
+    exact = (atomic_read(&_mmc_cache_writes) == 0);
+    smp_rmb();
+    linux_sectors = mmcblk_cache_written(bdev) -
+        atomic_long_read(&_mmc_cache_s_sectors);
+    smp_rmb();
+    exact = exact && atomic_read(&_mmc_cache_writes) == 0 &&
+        atomic_read(&_mmc_cache_write_seq) == seq;
+
+    if (exact && _mmc_cache.linux_valid &&
+        linux_sectors == _mmc_cache.linux_sectors) {
+        return;
+    }
+    mmcblk_cache_clear_locked();
+    _mmc_cache.linux_sectors = linux_sectors;
+    _mmc_cache.linux_valid = exact;
+}
+
+/**
+ * @brief A S write is about to be sent to device.
+ */
+static void mmcblk_cache_write_start(void)
+{
+    atomic_inc(&_mmc_cache_writes);
+    atomic_inc(&_mmc_cache_write_seq);
+    smp_mb__after_atomic();
+}
+
+/**
+ * @brief A S write of \p length bytes sent to device ended.
+ */
+static void mmcblk_cache_write_end(size_t length)
+{
+    atomic_long_add(length >> 9, &_mmc_cache_s_sectors);
+    smp_mb__before_atomic();
+    atomic_dec(&_mmc_cache_writes);
+}
+
+/**
+ * @brief Serve a read of \p length bytes at \p pos of \p bdev into \p data
+ * from the cache.
+ *
+ * Whole cache is dropped first if Linux wrote to device since last read.
+ *
+ * @param gen           set to cache generation, to give back to
+ *                      \ref mmcblk_cache_fill once read from device on miss
+ * @return              true if every block of the range is cached
+ */
+static bool mmcblk_cache_read(struct block_device *bdev, uint8_t *data,
+    loff_t pos, size_t length, unsigned long *gen)
+{
+    pgoff_t first = pos >> PAGE_SHIFT;
+    pgoff_t last = (pos + length - 1) >> PAGE_SHIFT;
+    struct mmcblk_cache_entry *e;
+    pgoff_t index;
+    bool hit = true;
+
+    mutex_lock(&_mmc_cache.lock);
+    mmcblk_cache_check_locked(bdev);
+    *gen = _mmc_cache.gen;
+    for (index = first; index <= last && hit; index++) {
+        hit = (mmcblk_cache_find(index) != NULL);
+    }
+    if (hit) {
+        for (index = first; index <= last; index++) {
+            e = mmcblk_cache_find(index);
+            mmcblk_cache_copy(data, page_address(e->page), index, pos, length,
+                false);
+            list_move(&e->lru, &_mmc_cache.lru);
+        }
+        _mmc_cache_hits++;
+    } else {
+        _mmc_cache_misses++;
+    }
+    mutex_unlock(&_mmc_cache.lock);
+    return hit;
+}
+
+/**
+ * @brief Cache blocks fully covered by a read of \p length bytes at \p pos
+ * into \p data.
+ *
+ * Nothing is cached if the cache was invalidated since \p gen was read.
+ */
+static void mmcblk_cache_fill(uint8_t *data, loff_t pos, size_t length,
+    unsigned long gen)
+{
+    pgoff_t first = DIV_ROUND_UP(pos, PAGE_SIZE);
+    pgoff_t end = (pos + length) >> PAGE_SHIFT;
+    struct mmcblk_cache_entry *e;
+    pgoff_t index;
+
+    mutex_lock(&_mmc_cache.lock);
+    for (index = first; index < end && gen == _mmc_cache.gen; index++) {
+        e = mmcblk_cache_find(index);
+        if (e != NULL) {
+            list_move(&e->lru, &_mmc_cache.lru);
+            continue;
+        }
+        if (_mmc_cache.nr_entries < CONFIG_PROVENCORE_MMC_CACHE_BLOCKS) {
+            e = kmalloc(sizeof(struct mmcblk_cache_entry), GFP_NOIO);
+            if (e == NULL) {
+                break;
+            }
+            e->page = alloc_page(GFP_NOIO);
+            if (e->page == NULL) {
+                kfree(e);
+                break;
+            }
+            _mmc_cache.nr_entries++;
+        } else {
+            /* Recycle least recently used entry */
+            e = list_last_entry(&_mmc_cache.lru, struct mmcblk_cache_entry, lru);
+            hash_del(&e->hash);
+            list_del(&e->lru);
+        }
+        e->index = index;
+        mmcblk_cache_copy(data, page_address(e->page), index, pos, length,
+            true);
+        hash_add(_mmc_cache.table, &e->hash, index);
+        list_add(&e->lru, &_mmc_cache.lru);
+    }
+    mutex_unlock(&_mmc_cache.lock);
+}
+
+/**
+ * @brief Drop cached blocks overlapping [\p pos, \p pos + \p length), about to
+ * be written.
+ */
+static void mmcblk_cache_invalidate(loff_t pos, size_t length)
+{
+    pgoff_t first = pos >> PAGE_SHIFT;
+    pgoff_t last = (pos + length - 1) >> PAGE_SHIFT;
+    struct mmcblk_cache_entry *e;
+    pgoff_t index;
+
+    mutex_lock(&_mmc_cache.lock);
+    _mmc_cache.gen++;
+    for (index = first; index <= last; index++) {
+        e = mmcblk_cache_find(index);
+        if (e != NULL) {
+            mmcblk_cache_remove(e);
+        }
+    }
+    mutex_unlock(&_mmc_cache.lock);
+}
+
+/**
+ * @brief Drop all cached blocks.
+ *
+ * Called when S takes the device back from Linux, or selects it again: Linux
+ * may have written to it in the meantime.
+ */
+static void mmcblk_cache_clear(void)
+{
+    mutex_lock(&_mmc_cache.lock);
+    mmcblk_cache_clear_locked();
+    mutex_unlock(&_mmc_cache.lock);
+}
+
+/* END Block cache for S reads --------------------------------------------- */
+
+#else /* !CONFIG_PROVENCORE_MMC_CACHE */
+
+static inline bool mmcblk_cache_read(struct block_device *bdev, uint8_t *data,
+    loff_t pos, size_t length, unsigned long *gen)
+{
+    return false;
+}
+
+static inline void mmcblk_cache_fill(uint8_t *data, loff_t pos, size_t length,
+    unsigned long gen) {}
+static inline void mmcblk_cache_invalidate(loff_t pos, size_t length) {}
+static inline void mmcblk_cache_clear(void) {}
+static inline void mmcblk_cache_write_start(void) {}
+static inline void mmcblk_cache_write_end(size_t length) {}
+
+#endif /* CONFIG_PROVENCORE_MMC_CACHE */
+
+#ifdef CONFIG_PROVENCORE_MMC_ARBITRATION
+#include <linux/blk-mq.h>
+#include <linux/delay.h>
+#include <linux/ktime.h>
+#include <linux/moduleparam.h>
+#include <linux/version.h>
+#include <linux/workqueue.h>
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5,8,0)
+#include <linux/part_stat.h>
+#endif
+
+#ifndef CONFIG_PROVENCORE_MMC_MAX_HOLD_MS
+#define CONFIG_PROVENCORE_MMC_MAX_HOLD_MS 100
+#endif
+
+#ifndef CONFIG_PROVENCORE_MMC_S_WEIGHT
+#define CONFIG_PROVENCORE_MMC_S_WEIGHT 1
+#endif
+
+#ifndef CONFIG_PROVENCORE_MMC_LINUX_WEIGHT
+#define CONFIG_PROVENCORE_MMC_LINUX_WEIGHT 1
+#endif
+
+/* Arbitration between Linux and S ----------------------------------------- */
+
+/** MMC arbitration state, only used with device lease lock held */
+static struct {
+    /* Start of S hold, 0 if Linux owns device */
+    ktime_t held_since;
+    /* End of Linux window: S waits for it before taking device again */
+    ktime_t linux_until;
+    /* Queue held while S owns device, NULL if not quiesced */
+    struct request_queue *queue;
+    /* Duration of last S hold, not yet known to have delayed Linux I/O */
+    s64 hold_us;
+    /* Num of I/O completed by Linux when S gave device back */
+    unsigned long ios;
+} _mmc_arb;
+
+/* Linux window wait step: Linux is idle if it completed no I/O meanwhile */
+#define MMC_ARB_POLL_MS 10
+
+static unsigned long _mmc_arb_s_wait_us;
+module_param_named(mmc_s_wait_us, _mmc_arb_s_wait_us, ulong, S_IRUGO);
+MODULE_PARM_DESC(mmc_s_wait_us, "Time S waited for Linux window to end");
+
+static unsigned long _mmc_arb_linux_wait_us;
+module_param_named(mmc_linux_wait_us, _mmc_arb_linux_wait_us, ulong, S_IRUGO);
+MODULE_PARM_DESC(mmc_linux_wait_us,
+    "Time S held device while Linux had I/O to process");
+
+static unsigned long _mmc_arb_max_hold_us;
+module_param_named(mmc_max_hold_us, _mmc_arb_max_hold_us, ulong, S_IRUGO);
+MODULE_PARM_DESC(mmc_max_hold_us, "Longest S hold of the device");
+
+static unsigned long _mmc_arb_yields;
+module_param_named(mmc_yields, _mmc_arb_yields, ulong, S_IRUGO);
+MODULE_PARM_DESC(mmc_yields, "Num of yield requests sent to S");
+
+static void mmcblk_yield_work_func(struct work_struct *work)
+{
+    (void)work;
+    pr_debug("(%s) S holds mmc for more than %u ms\n", __func__,
+        CONFIG_PROVENCORE_MMC_MAX_HOLD_MS);
+    _mmc_arb_yields++;
+    shdev_send_signal(SHDEV_SIGNAL(SIGNAL_MMC_YIELD));
+}
+static DECLARE_DELAYED_WORK(_mmc_yield_work, mmcblk_yield_work_func);
+
+/**
+ * @brief Num of I/O completed by Linux on \p bdev so far.
+ */
+static unsigned long mmcblk_arb_ios(struct block_device *bdev)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5,11,0)
+    struct block_device *part = bdev;
+#else
+    struct hd_struct *part = bdev->bd_part;
+#endif
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,19,0)
+    return part_stat_read(part, ios[STAT_READ]) +
+        part_stat_read(part, ios[STAT_WRITE]);
+#else
+    return part_stat_read(part, ios[READ]) + part_stat_read(part, ios[WRITE]);
+#endif
+}
+
+/**
+ * @brief Tell whether Linux still has I/O being processed by mmc host.
+ */
+static bool mmcblk_arb_inflight(struct request_queue *q)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5,2,0)
+    return q->mq_ops && blk_mq_queue_inflight(q);
+#else
+    (void)q;
+    return false;
+#endif
+}
+
+/**
+ * @brief S is about to take device: wait for end of Linux window, then hold
+ * Linux requests in block queue until S gives device back.
+ *
+ * Wait is bounded by max hold time, and ends as soon as Linux is idle. Last S
+ * hold is only counted as Linux wait if Linux had I/O to complete since then:
+ * I/O queued during hold are only completed once S gave device back.
+ */
+static void mmcblk_arb_take(struct block_device *bdev)
+{
+    struct request_queue *q = bdev_get_queue(bdev);
+    ktime_t start = ktime_get();
+    ktime_t until = ktime_add_ms(start, CONFIG_PROVENCORE_MMC_MAX_HOLD_MS);
+    unsigned long ios = _mmc_arb.ios;
+    s64 wait_ms;
+
+    if (ktime_before(_mmc_arb.linux_until, until)) {
+        until = _mmc_arb.linux_until;
+    }
+    wait_ms = ktime_ms_delta(until, start);
+    if (wait_ms > 0) {
+        do {
+            unsigned long now_ios;
+
+            msleep(min_t(s64, wait_ms, MMC_ARB_POLL_MS));
+            now_ios = mmcblk_arb_ios(bdev);
+            if (now_ios == ios && !mmcblk_arb_inflight(q)) {
+                break;
+            }
+            ios = now_ios;
+            wait_ms = ktime_ms_delta(until, ktime_get());
+        } while (wait_ms > 0);
+        _mmc_arb_s_wait_us += ktime_us_delta(ktime_get(), start);
+    }
+    _mmc_arb.linux_until = 0;
+
+    if (_mmc_arb.hold_us > 0 && (mmcblk_arb_ios(bdev) != _mmc_arb.ios ||
+            mmcblk_arb_inflight(q))) {
+        _mmc_arb_linux_wait_us += _mmc_arb.hold_us;
+    }
+    _mmc_arb.hold_us = 0;
+
+    /* Linux requests are queued, not sent to suspended host */
+    if (q->mq_ops) {
+        blk_mq_quiesce_queue(q);
+        _mmc_arb.queue = q;
+    }
+    _mmc_arb.held_since = ktime_get();
+    schedule_delayed_work(&_mmc_yield_work,
+        msecs_to_jiffies(CONFIG_PROVENCORE_MMC_MAX_HOLD_MS));
+}
+
+/**
+ * @brief S gave device back: release Linux requests, and give Linux a window
+ * proportional to S hold.
+ */
+static void mmcblk_arb_give(struct block_device *bdev)
+{
+    ktime_t now = ktime_get();
+    s64 hold_us, window_us;
+
+    cancel_delayed_work_sync(&_mmc_yield_work);
+    if (_mmc_arb.held_since != 0) {
+        _mmc_arb.ios = mmcblk_arb_ios(bdev);
+    }
+    if (_mmc_arb.queue != NULL) {
+        blk_mq_unquiesce_queue(_mmc_arb.queue);
+        _mmc_arb.queue = NULL;
+    }
+    if (_mmc_arb.held_since == 0) {
+        return;
+    }
+
+    hold_us = ktime_us_delta(now, _mmc_arb.held_since);
+    _mmc_arb.held_since = 0;
+    _mmc_arb.hold_us = hold_us;
+    if (hold_us > _mmc_arb_max_hold_us) {
+        _mmc_arb_max_hold_us = hold_us;
+    }
+
+    window_us = min_t(s64, hold_us, CONFIG_PROVENCORE_MMC_MAX_HOLD_MS * 1000LL);
+    window_us = window_us * CONFIG_PROVENCORE_MMC_LINUX_WEIGHT /
+        CONFIG_PROVENCORE_MMC_S_WEIGHT;
+    _mmc_arb.linux_until = ktime_add_us(now, window_us);
+}
+
+/**
+ * @brief Tell whether S held device for more than max hold time: its lease
+ * is not renewed then, Linux gets its window.
+ */
+static bool mmcblk_hold_expired(void)
+{
+    return _mmc_arb.held_since != 0 &&
+        ktime_ms_delta(ktime_get(), _mmc_arb.held_since) >=
+            CONFIG_PROVENCORE_MMC_MAX_HOLD_MS;
+}
+
+/* END Arbitration between Linux and S ------------------------------------- */
+
+#else /* !CONFIG_PROVENCORE_MMC_ARBITRATION */
+
+static inline void mmcblk_arb_take(struct block_device *bdev) {}
+static inline void mmcblk_arb_give(struct block_device *bdev) {}
+
+#endif /* CONFIG_PROVENCORE_MMC_ARBITRATION */
+
 static int mmcblk_suspend(void)
 {
     int result;
@@ -186,8 +727,19 @@ static int mmcblk_suspend(void)
         return -ENODEV;
     }
     pr_debug("(%s)\n", __func__);
+    mmcblk_cache_clear();
+#ifdef CONFIG_PROVENCORE_MMC_REMOTE_HOST
+    /* Acknowledged S writes reach device before S accesses it directly */
+    mmcblk_merge_drain();
+#endif
+    /* Host suspend ioctl is not queued: queue can be quiesced first */
+    mmcblk_arb_take(bdev);
     result = blkdev_ioctl(bdev, 0,
                 _IO(MMC_BLOCK_MAJOR, CONFIG_PROVENCORE_MMC_IOCTL_SUSPEND), 0);
+    if (result != 0) {
+        /* No resume follows: Linux requests must not stay held */
+        mmcblk_arb_give(bdev);
+    }
     mmcblk_pm_runtime_disable();
     return result;
 }
@@ -200,14 +752,27 @@ static int mmcblk_resume(void)
         return -ENODEV;
     }
     pr_debug("(%s)\n", __func__);
+#ifdef CONFIG_PROVENCORE_MMC_REMOTE_HOST
+    /* Device goes back to Linux: it gets S writes. Any failure is left for
+     * next S write or flush */
+    mmcblk_merge_sync(0, 0);
+#endif
     result = blkdev_ioctl(bdev, 0,
                 _IO(MMC_BLOCK_MAJOR, CONFIG_PROVENCORE_MMC_IOCTL_RESUME), 0);
     mmcblk_pm_runtime_enable();
+    mmcblk_arb_give(bdev);
     return result;
 }
 
 #ifdef CONFIG_PROVENCORE_MMC_REMOTE_HOST
 #include <linux/version.h>
+#include <linux/bio.h>
+#include <linux/llist.h>
+#include <linux/mm.h>
+#include <linux/pagemap.h>
+#include <linux/vmalloc.h>
+#include <linux/wait.h>
+#include <linux/workqueue.h>
 #include <linux/mmc/host.h>
 #include <linux/mmc/ioctl.h>
 #include <linux/mmc/mmc.h>
@@ -216,6 +781,19 @@ static int mmcblk_resume(void)
 /* Physical partitions */
 #define MMC_PART_USER       0
 
+#ifndef BIO_MAX_VECS
+#define BIO_MAX_VECS        BIO_MAX_PAGES
+#endif
+
+/** Mode of the block device handle used for remote host I/O */
+#define MMC_IO_FMODE        (FMODE_READ | FMODE_WRITE)
+
+/**
+ * Block device handle used for remote host I/O, opened on first transfer and
+ * kept until module exit
+ */
+static struct block_device *_shdev_mmc_io_bdev = NULL;
+
 #ifdef CONFIG_PROVENCORE_MMC_USE_RPMB
 
 #ifndef CONFIG_PROVENCORE_MMC_RPMB_DEVICE
@@ -252,6 +830,67 @@ struct rpmb_frame {
     cmd.data_ptr = ptr;          \
 }
 
+/** Size of RPMB multi command buffer */
+#define RPMB_MULTI_CMD_SIZE     (sizeof(struct mmc_ioc_multi_cmd) + \
+                                 RPMB_MULTI_CMD_MAX_CMDS * sizeof(struct mmc_ioc_cmd))
+
+/** RPMB device, opened on first request and kept until module exit */
+static struct file *_shdev_rpmb_filp = NULL;
+
+/** RPMB multi command buffer, allocated along with \ref _shdev_rpmb_filp */
+static struct mmc_ioc_multi_cmd *_shdev_rpmb_cmds = NULL;
+
+/** Status request frame of RPMB writes */
+static struct rpmb_frame _shdev_rpmb_status;
+
+/**
+ * @brief Get the RPMB device file, opening it if needed.
+ *
+ * Requests are serialized by the MMC work, hence no locking.
+ */
+static struct file *mmcblk_rpmb_get(void)
+{
+    struct file *filp;
+
+    if (_shdev_rpmb_filp != NULL) {
+        return _shdev_rpmb_filp;
+    }
+    filp = filp_open(CONFIG_PROVENCORE_MMC_RPMB_DEVICE, O_RDWR, 0);
+    if (IS_ERR(filp)) {
+        return filp;
+    }
+    if (!filp->f_op || !filp->f_op->unlocked_ioctl) {
+        filp_close(filp, 0);
+        return ERR_PTR(-EACCES);
+    }
+    _shdev_rpmb_cmds = kmalloc(RPMB_MULTI_CMD_SIZE, GFP_KERNEL);
+    if (_shdev_rpmb_cmds == NULL) {
+        filp_close(filp, 0);
+        return ERR_PTR(-ENOMEM);
+    }
+    _shdev_rpmb_filp = filp;
+    return filp;
+}
+
+static void mmcblk_rpmb_release(void)
+{
+    if (_shdev_rpmb_filp != NULL) {
+        filp_close(_shdev_rpmb_filp, 0);
+        _shdev_rpmb_filp = NULL;
+    }
+    kfree(_shdev_rpmb_cmds);
+    _shdev_rpmb_cmds = NULL;
+}
+
+/**
+ * @brief Handle a RPMB request.
+ *
+ * Request frames are in MMC data buffer. Entry's length gives the num of
+ * frames of the request, a single frame if 0:
+ *  - for a write, the num of frames written, result frame is returned in
+ *    first one
+ *  - for a read, the num of frames read, request frame being the first one
+ */
 static int mmcblk_remote_host_rpmb(shdev_desc_t *desc_ptr)
 {
     shdev_message_t *shdev_mptr = NULL;
@@ -259,18 +898,17 @@ static int mmcblk_remote_host_rpmb(shdev_desc_t *desc_ptr)
     int result = -EACCES;
     struct mmc_ioc_multi_cmd *pcmds = NULL;
     struct rpmb_frame *frame = NULL;
+    struct file *filp;
+    uint64_t nr_frames;
 
     shdev_mptr     = &desc_ptr->s_to_ns;
     shdev_mmc_mptr = (shdev_mmc_entry_t *)(_shdev_shm_addr + desc_ptr->entry_offset);
     frame          = (struct rpmb_frame *) (_shdev_shm_addr + desc_ptr->data_offset);
 
-    struct file* filp = filp_open(CONFIG_PROVENCORE_MMC_RPMB_DEVICE, O_RDWR, 0);
+    filp = mmcblk_rpmb_get();
     if (IS_ERR(filp))
         return result;
 
-    if (!filp->f_op || !filp->f_op->unlocked_ioctl)
-        goto end;
-
     if (shdev_mptr->operation == SELECT_DEVICE) {
         unsigned long blkcnt = 0;
         unsigned long blksize = 0;
@@ -284,7 +922,7 @@ static int mmcblk_remote_host_rpmb(shdev_desc_t *desc_ptr)
             pr_err("%s: ioctl BLKGETSIZE failed with error %d\n", __func__, result);
             pr_err("%s: CONFIG_PROVENCORE_MMC_RPMB_USE_DEFAULT_BLKCNT "
                    "can be considered to set the default block count\n", __func__);
-            goto end;
+            return result;
         }
 #endif
 
@@ -298,29 +936,37 @@ static int mmcblk_remote_host_rpmb(shdev_desc_t *desc_ptr)
             pr_err("%s: ioctl BLKPBSZGET failed with error %d\n", __func__, result);
             pr_err("%s: CONFIG_PROVENCORE_MMC_RPMB_USE_DEFAULT_BLKSIZE "
                    "can be considered to set the default block count\n", __func__);
-            goto end;
+            return result;
         }
 #endif
 
         shdev_mmc_mptr->offset = blksize;
         shdev_mmc_mptr->length = blksize * blkcnt;
-        goto end; // ok case
+        return result; // ok case
     }
 
-    pcmds = (struct mmc_ioc_multi_cmd *) kmalloc(sizeof(struct mmc_ioc_multi_cmd) +
-                RPMB_MULTI_CMD_MAX_CMDS * sizeof(struct mmc_ioc_cmd), GFP_KERNEL);
-    if (pcmds == NULL)
-        goto end;
+    /* Length is the partition size set by SELECT_DEVICE for a S not
+     * knowing about multi-frame requests: only explicit frame count is used */
+    nr_frames = READ_ONCE(shdev_mmc_mptr->rpmb_frames);
+    if (nr_frames == 0) {
+        nr_frames = 1;
+    }
+    if (nr_frames > desc_ptr->data_size / RPMB_FRAME_SIZE) {
+        pr_err("%s: out of bound rpmb request: %llu frames\n", __func__,
+                nr_frames);
+        return -EINVAL;
+    }
 
+    pcmds = _shdev_rpmb_cmds;
     /* Set: .is_acmd .arg .postsleep_min_us .postsleep_max_us
      *      .data_timeout_ns .cmd_timeout_ms to 0 */
-    memset(pcmds, 0x0, sizeof(struct mmc_ioc_multi_cmd) +
-            RPMB_MULTI_CMD_MAX_CMDS * sizeof(struct mmc_ioc_cmd));
+    memset(pcmds, 0x0, RPMB_MULTI_CMD_SIZE);
     /* Init common request */
     INIT_MMC_IOC_CMD(pcmds->cmds[0], MMC_WRITE_MULTIPLE_BLOCK, 1,
                      (unsigned long) frame);
 
-    pr_debug("%s rpmb request %u\n", __func__, be16_to_cpu(frame->request));
+    pr_debug("%s rpmb request %u, %llu frames\n", __func__,
+            be16_to_cpu(frame->request), nr_frames);
     switch (be16_to_cpu(frame->request)) {
         case RPMB_REQ_COUNTER:
         case RPMB_REQ_READ:
@@ -329,6 +975,11 @@ static int mmcblk_remote_host_rpmb(shdev_desc_t *desc_ptr)
 
             INIT_MMC_IOC_CMD(pcmds->cmds[1], MMC_READ_MULTIPLE_BLOCK, 0,
                              (unsigned long) frame);
+            /* Several frames read at once for a multi block read, counter
+             * is a single frame */
+            if (be16_to_cpu(frame->request) == RPMB_REQ_READ) {
+                pcmds->cmds[1].blocks = (unsigned int)nr_frames;
+            }
 
             pcmds->num_of_cmds = RPMB_REQ_READ_COUNTER_CMDS;
             /* MMC should not be suspended during the execution of this command */
@@ -338,14 +989,16 @@ static int mmcblk_remote_host_rpmb(shdev_desc_t *desc_ptr)
         case RPMB_REQ_WRITE:
         {
             #define RPMB_REQ_WRITE_CMDS   3
-            struct rpmb_frame frame_status = { 0 };
-            frame_status.request = cpu_to_be16(RPMB_REQ_STATUS);
+            memset(&_shdev_rpmb_status, 0, sizeof(struct rpmb_frame));
+            _shdev_rpmb_status.request = cpu_to_be16(RPMB_REQ_STATUS);
 
             /* RPMB_REQ_WRITE need reliable flag */
             pcmds->cmds[0].write_flag = 1 | RPMB_WRITE_FLAG_RELIABLE;
+            /* Several frames written at once for a multi block write */
+            pcmds->cmds[0].blocks = (unsigned int)nr_frames;
 
             INIT_MMC_IOC_CMD(pcmds->cmds[1], MMC_WRITE_MULTIPLE_BLOCK, 1,
-                             (unsigned long)&frame_status);
+                             (unsigned long)&_shdev_rpmb_status);
 
             INIT_MMC_IOC_CMD(pcmds->cmds[2], MMC_READ_MULTIPLE_BLOCK, 0,
                              (unsigned long) frame);
@@ -360,9 +1013,6 @@ static int mmcblk_remote_host_rpmb(shdev_desc_t *desc_ptr)
             break; // switch () {}
     } /* END switch (be16_to_cpu(frame->request)) { */
 
-    kfree(pcmds);
-end:
-    filp_close(filp, 0);
     return result;
 }
 
@@ -370,6 +1020,458 @@ end:
 
 #endif /* CONFIG_PROVENCORE_MMC_USE_RPMB */
 
+/**
+ * @brief Get the block device handle used for READ/WRITE requests.
+ *
+ * The handle is opened once and kept until module exit.
+ */
+static struct block_device *mmcblk_io_get(void)
+{
+    static DEFINE_MUTEX(lock);
+    struct block_device *bdev;
+
+    if (READ_ONCE(_shdev_mmc_io_bdev) != NULL) {
+        return _shdev_mmc_io_bdev;
+    }
+    mutex_lock(&lock);
+    if (_shdev_mmc_io_bdev != NULL) {
+        bdev = _shdev_mmc_io_bdev;
+        goto end;
+    }
+    bdev = mmcblk_get();
+    if (IS_ERR(bdev)) {
+        goto end;
+    }
+    bdev = blkdev_get_by_dev(bdev->bd_dev, MMC_IO_FMODE, NULL);
+    if (IS_ERR(bdev)) {
+        pr_err("(%s) can't open \"" CONFIG_PROVENCORE_MMC_DEVICE "\" (%ld)\n",
+            __func__, PTR_ERR(bdev));
+        goto end;
+    }
+    WRITE_ONCE(_shdev_mmc_io_bdev, bdev);
+end:
+    mutex_unlock(&lock);
+    return bdev;
+}
+
+/**
+ * @brief Get the page backing SHM data address \p addr.
+ *
+ * Session SHM is either in the linear mapping or vmapped.
+ */
+static struct page *mmcblk_data_page(const uint8_t *addr)
+{
+    if (is_vmalloc_addr(addr)) {
+        return vmalloc_to_page(addr);
+    }
+    return virt_to_page(addr);
+}
+
+/**
+ * @brief Check a transfer of \p length bytes at device offset \p pos, from or
+ * to SHM data buffer \p data, fits device constraints.
+ *
+ * @return              - 0 if transfer is valid
+ *                      - -EINVAL if \p pos, \p length or \p data are not
+ *                        aligned on device logical block size
+ */
+static int mmcblk_check_transfer(struct block_device *bdev,
+    const uint8_t *data, loff_t pos, size_t length, bool write)
+{
+    unsigned int mask = bdev_logical_block_size(bdev) - 1;
+
+    if (((pos | length | offset_in_page(data)) & mask) != 0) {
+        pr_err("%s: unaligned %s request: offset=%llu length=%zu\n", __func__,
+            (write) ? "write":"read", (unsigned long long)pos, length);
+        return -EINVAL;
+    }
+    return 0;
+}
+
+/**
+ * @brief Allocate and fill a bio transferring up to \p length - \p *done
+ * bytes from \p data + \p *done, at device offset \p pos + \p *done.
+ *
+ * \p *done is updated with bytes covered by the bio.
+ *
+ * @return              - the bio, NULL if no page could be added
+ */
+static struct bio *mmcblk_bio_build(struct block_device *bdev, uint8_t *data,
+    loff_t pos, size_t length, size_t *done, unsigned int op)
+{
+    unsigned int nr_vecs, len;
+    struct bio *bio;
+    uint8_t *ptr;
+
+    nr_vecs = min_t(unsigned long, BIO_MAX_VECS,
+        DIV_ROUND_UP(offset_in_page(data + *done) + length - *done, PAGE_SIZE));
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5,18,0)
+    bio = bio_alloc(bdev, nr_vecs, op, GFP_NOIO);
+#else
+    bio = bio_alloc(GFP_NOIO, nr_vecs);
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,14,0)
+    bio_set_dev(bio, bdev);
+#else
+    bio->bi_bdev = bdev;
+#endif
+    bio->bi_opf = op;
+#endif
+    bio->bi_iter.bi_sector = (pos + *done) >> 9;
+    /* Fill bio until full: remaining is sent by next one */
+    while (*done < length) {
+        ptr = data + *done;
+        len = min_t(size_t, PAGE_SIZE - offset_in_page(ptr), length - *done);
+        if (bio_add_page(bio, mmcblk_data_page(ptr), len,
+                offset_in_page(ptr)) != len) {
+            break;
+        }
+        *done += len;
+    }
+    if (bio->bi_iter.bi_size == 0) {
+        bio_put(bio);
+        return NULL;
+    }
+    return bio;
+}
+
+/**
+ * @brief Write back dirty page cache of device range [\p pos, \p pos +
+ * \p length) before bios bypass it: S reads see Linux writes, and Linux
+ * writeback can't overwrite S writes later.
+ */
+static int mmcblk_sync(struct block_device *bdev, loff_t pos, size_t length)
+{
+    return filemap_write_and_wait_range(bdev->bd_inode->i_mapping, pos,
+        pos + length - 1);
+}
+
+/**
+ * @brief Drop page cache of device range [\p pos, \p pos + \p length) written
+ * behind its back, so Linux readers of the device don't see stale data.
+ */
+static void mmcblk_invalidate(struct block_device *bdev, loff_t pos,
+    size_t length)
+{
+    int ret;
+
+    ret = invalidate_inode_pages2_range(bdev->bd_inode->i_mapping,
+        pos >> PAGE_SHIFT, (pos + length - 1) >> PAGE_SHIFT);
+    if (ret != 0) {
+        pr_warn_ratelimited("%s: stale page cache at offset=%llu (%d)\n",
+            __func__, (unsigned long long)pos, ret);
+    }
+}
+
+/**
+ * @brief Transfer \p length bytes between device offset \p pos and SHM data
+ * buffer \p data.
+ *
+ * Bios are built straight on the SHM pages and bypass the page cache: range
+ * is written back first, and dropped from it after a write.
+ *
+ * @return              - 0 on success
+ *                      - -EINVAL if request is not aligned on device logical
+ *                        block size
+ *                      - negative error code otherwise
+ */
+static int mmcblk_transfer(uint8_t *data, loff_t pos, size_t length,
+    bool write)
+{
+    struct block_device *bdev = mmcblk_io_get();
+    unsigned int op = write ? (REQ_OP_WRITE | REQ_SYNC) : REQ_OP_READ;
+    size_t done = 0;
+    struct bio *bio;
+    unsigned long gen;
+    int ret = 0;
+
+    if (IS_ERR(bdev)) {
+        return PTR_ERR(bdev);
+    }
+    ret = mmcblk_check_transfer(bdev, data, pos, length, write);
+    if (ret != 0) {
+        return ret;
+    }
+    if (write) {
+        mmcblk_cache_invalidate(pos, length);
+    } else if (mmcblk_cache_read(bdev, data, pos, length, &gen)) {
+        return 0;
+    }
+    ret = mmcblk_sync(bdev, pos, length);
+    if (ret != 0) {
+        return ret;
+    }
+
+    if (write) {
+        mmcblk_cache_write_start();
+    }
+    while (done < length && ret == 0) {
+        bio = mmcblk_bio_build(bdev, data, pos, length, &done, op);
+        if (bio == NULL) {
+            ret = -EIO;
+            break;
+        }
+        ret = submit_bio_wait(bio);
+        bio_put(bio);
+    }
+    if (write) {
+        mmcblk_cache_write_end(done);
+    }
+    if (write && done != 0) {
+        mmcblk_invalidate(bdev, pos, done);
+    } else if (!write && ret == 0) {
+        mmcblk_cache_fill(data, pos, length, gen);
+    }
+    return ret;
+}
+
+/**
+ * @brief Send device cache content to permanent storage.
+ */
+static int mmcblk_issue_flush(void)
+{
+    struct block_device *bdev = mmcblk_io_get();
+
+    if (IS_ERR(bdev)) {
+        return PTR_ERR(bdev);
+    }
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5,12,0)
+    return blkdev_issue_flush(bdev);
+#elif LINUX_VERSION_CODE >= KERNEL_VERSION(5,8,0)
+    return blkdev_issue_flush(bdev, GFP_KERNEL);
+#else
+    return blkdev_issue_flush(bdev, GFP_KERNEL, NULL);
+#endif
+}
+
+#ifdef CONFIG_PROVENCORE_MMC_WRITE_MERGE
+
+#ifndef CONFIG_PROVENCORE_MMC_MERGE_PAGES
+#define CONFIG_PROVENCORE_MMC_MERGE_PAGES 64
+#endif
+
+/* Merging S writes -------------------------------------------------------- */
+
+/** Delay before merged writes are sent to device if no flush comes */
+#define MMC_MERGE_DELAY     msecs_to_jiffies(50)
+
+/** Contiguous S writes acknowledged but not sent to device yet */
+static struct {
+    struct mutex lock;
+    /* Merge buffer, CONFIG_PROVENCORE_MMC_MERGE_PAGES pages */
+    uint8_t *buf;
+    /* Device range of pending writes, length is 0 if none */
+    loff_t pos;
+    size_t length;
+    /* Error of a background write, reported to next write or flush */
+    int error;
+} _mmc_merge = {
+    .lock = __MUTEX_INITIALIZER(_mmc_merge.lock),
+};
+
+static void mmcblk_merge_work_func(struct work_struct *work);
+static DECLARE_DELAYED_WORK(_mmc_merge_work, mmcblk_merge_work_func);
+
+/**
+ * @brief Send pending writes to device. Called with merge lock held.
+ */
+static int mmcblk_merge_flush_locked(void)
+{
+    int ret;
+
+    if (_mmc_merge.length == 0) {
+        return 0;
+    }
+    ret = mmcblk_transfer(_mmc_merge.buf, _mmc_merge.pos, _mmc_merge.length,
+        true);
+    _mmc_merge.length = 0;
+    return ret;
+}
+
+static void mmcblk_merge_work_func(struct work_struct *work)
+{
+    int ret;
+
+    (void)work;
+    mutex_lock(&_mmc_merge.lock);
+    ret = mmcblk_merge_flush_locked();
+    if (ret != 0 && _mmc_merge.error == 0) {
+        _mmc_merge.error = ret;
+    }
+    mutex_unlock(&_mmc_merge.lock);
+}
+
+/**
+ * @brief Send pending writes overlapping [\p pos, \p pos + \p length) to
+ * device, all of them if \p length is 0.
+ *
+ * A failure is also kept for \ref mmcblk_merge_error: acknowledged writes
+ * are lost, S learns it with its next write or flush.
+ *
+ * @return              error of sending pending writes
+ */
+static int mmcblk_merge_sync(loff_t pos, size_t length)
+{
+    int ret = 0;
+
+    mutex_lock(&_mmc_merge.lock);
+    if (_mmc_merge.length != 0 && (length == 0 ||
+        (pos < _mmc_merge.pos + (loff_t)_mmc_merge.length &&
+         _mmc_merge.pos < pos + (loff_t)length))) {
+        ret = mmcblk_merge_flush_locked();
+        if (ret != 0 && _mmc_merge.error == 0) {
+            /* Acknowledged writes are lost: S must know */
+            _mmc_merge.error = ret;
+        }
+    }
+    mutex_unlock(&_mmc_merge.lock);
+    return ret;
+}
+
+/**
+ * @brief Get and clear first error of sending acknowledged writes to device,
+ * since last call or write.
+ */
+static int mmcblk_merge_error(void)
+{
+    int ret;
+
+    mutex_lock(&_mmc_merge.lock);
+    ret = _mmc_merge.error;
+    _mmc_merge.error = 0;
+    mutex_unlock(&_mmc_merge.lock);
+    return ret;
+}
+
+/**
+ * @brief Handle a S write of \p length bytes at \p pos from \p data.
+ *
+ * Write is appended to pending ones if contiguous and acknowledged at once,
+ * it is durable only once S sends FLUSH_DEVICE. Pending writes are sent to
+ * device when a non contiguous write comes, when merge buffer is full, or
+ * after \ref MMC_MERGE_DELAY.
+ */
+static int mmcblk_merge_write(uint8_t *data, loff_t pos, size_t length)
+{
+    size_t size = CONFIG_PROVENCORE_MMC_MERGE_PAGES * PAGE_SIZE;
+    struct block_device *bdev = mmcblk_io_get();
+    int ret;
+
+    if (IS_ERR(bdev)) {
+        return PTR_ERR(bdev);
+    }
+    ret = mmcblk_check_transfer(bdev, data, pos, length, true);
+    if (ret != 0) {
+        return ret;
+    }
+
+    mutex_lock(&_mmc_merge.lock);
+    /* Former write failure is reported first */
+    ret = _mmc_merge.error;
+    _mmc_merge.error = 0;
+    if (ret != 0) {
+        goto end;
+    }
+    if (_mmc_merge.buf == NULL) {
+        _mmc_merge.buf = vmalloc(size);
+    }
+    if (_mmc_merge.length != 0 &&
+        (pos != _mmc_merge.pos + (loff_t)_mmc_merge.length ||
+         _mmc_merge.length + length > size)) {
+        ret = mmcblk_merge_flush_locked();
+        if (ret != 0) {
+            goto end;
+        }
+    }
+    if (_mmc_merge.buf == NULL || length > size) {
+        /* Can't be merged */
+        ret = mmcblk_transfer(data, pos, length, true);
+        goto end;
+    }
+
+    if (_mmc_merge.length == 0) {
+        _mmc_merge.pos = pos;
+    }
+    memcpy(_mmc_merge.buf + _mmc_merge.length, data, length);
+    _mmc_merge.length += length;
+    mmcblk_cache_invalidate(pos, length);
+    mod_delayed_work(system_wq, &_mmc_merge_work, MMC_MERGE_DELAY);
+end:
+    mutex_unlock(&_mmc_merge.lock);
+    return ret;
+}
+
+/**
+ * @brief Send pending writes to device now, not from background work: S is
+ * about to take device. A failure is left for next S write or flush.
+ */
+static void mmcblk_merge_drain(void)
+{
+    cancel_delayed_work_sync(&_mmc_merge_work);
+    mmcblk_merge_sync(0, 0);
+}
+
+/**
+ * @brief Send pending writes to device and release merge buffer.
+ */
+static void mmcblk_merge_release(void)
+{
+    int ret;
+
+    mmcblk_merge_drain();
+    ret = mmcblk_merge_error();
+    if (ret != 0) {
+        pr_err("%s: acknowledged S writes lost (%d)\n", __func__, ret);
+    }
+    vfree(_mmc_merge.buf);
+    _mmc_merge.buf = NULL;
+}
+
+/* END Merging S writes ---------------------------------------------------- */
+
+#else /* !CONFIG_PROVENCORE_MMC_WRITE_MERGE */
+
+static inline int mmcblk_merge_sync(loff_t pos, size_t length)
+{
+    return 0;
+}
+
+static inline int mmcblk_merge_error(void)
+{
+    return 0;
+}
+
+static inline void mmcblk_merge_drain(void) {}
+
+static inline int mmcblk_merge_write(uint8_t *data, loff_t pos, size_t length)
+{
+    return mmcblk_transfer(data, pos, length, true);
+}
+
+static inline void mmcblk_merge_release(void) {}
+
+#endif /* CONFIG_PROVENCORE_MMC_WRITE_MERGE */
+
+/**
+ * @brief Handle FLUSH_DEVICE: make S writes acknowledged so far durable.
+ *
+ * Requests of MMC I/O rings are covered once completed.
+ */
+static int mmcblk_remote_flush(shdev_desc_t *desc_ptr)
+{
+    int ret, err;
+
+    if (desc_ptr->id != SHDEV_DEVICE_TO_ID(MMC_DEVICE)) {
+        pr_err("%s: invalid device (%u) !\n", __func__, desc_ptr->id);
+        return -EINVAL;
+    }
+    pr_debug("(%s)\n", __func__);
+    /* Writes sent in background or on resume may have failed too */
+    mmcblk_merge_sync(0, 0);
+    ret = mmcblk_merge_error();
+    err = mmcblk_issue_flush();
+    return (ret != 0) ? ret : err;
+}
+
 static int mmcblk_remote_host(shdev_desc_t *desc_ptr)
 {
     int ret = -EACCES;
@@ -404,6 +1506,8 @@ static int mmcblk_remote_host(shdev_desc_t *desc_ptr)
                 if (IS_ERR(bdev)) {
                     break;
                 }
+                /* Linux writes are not seen by the cache */
+                mmcblk_cache_clear();
 
                 ret = blkdev_ioctl(bdev, 0, BLKGETSIZE, (unsigned long)&blkcnt);
                 if (ret != 0)
@@ -422,13 +1526,11 @@ static int mmcblk_remote_host(shdev_desc_t *desc_ptr)
             {
                 uint8_t *mmc_data_ptr = NULL;
                 bool write = (shdev_mptr->operation == WRITE_DEVICE);
-                struct file* filp;
                 loff_t pos;
                 size_t length;
-                ssize_t transferred_bytes = 0;
 
                 /* Check length of the transfer request */
-                if ((uint32_t)shdev_mmc_mptr->length > desc_ptr->data_size) {
+                if (shdev_mmc_mptr->length > desc_ptr->data_size) {
                     pr_err("%s: out of bound %s request: %llu/%lu\n", __func__,
                             (write) ? "write":"read", shdev_mmc_mptr->length,
                             (unsigned long)desc_ptr->data_size);
@@ -437,34 +1539,19 @@ static int mmcblk_remote_host(shdev_desc_t *desc_ptr)
                 pr_debug("%s: %s: offset=%lu length=%lu\n", __func__,
                         (write) ? "write":"read",
                         (unsigned long)shdev_mmc_mptr->offset, (unsigned long)shdev_mmc_mptr->length);
-                filp   = filp_open(CONFIG_PROVENCORE_MMC_DEVICE, O_RDWR, 0);
-                if (IS_ERR(filp)) {
-                    return PTR_ERR(filp);
-                }
                 pos    = (loff_t) shdev_mmc_mptr->offset; // offset in bytes
                 length = (size_t) shdev_mmc_mptr->length; // number of bytes
-                transferred_bytes = 0;
                 /* Get address of MMC SHM data buffer */
                 mmc_data_ptr = (uint8_t *)(_shdev_shm_addr + desc_ptr->data_offset);
                 if (write) {
-#if LINUX_VERSION_CODE <= KERNEL_VERSION(4,13,0)
-                    transferred_bytes = (ssize_t) kernel_write(filp, (void *)mmc_data_ptr, length, pos);
-#else  /* KERNEL_VERSION > 4,13,0) */
-                    transferred_bytes = kernel_write(filp, (void *)mmc_data_ptr, length, &pos);
-#endif /* LINUX_VERSION_CODE <= KERNEL_VERSION(4,13,0) */
-                } else {
-#if LINUX_VERSION_CODE <= KERNEL_VERSION(4,13,0)
-                    transferred_bytes = (ssize_t) kernel_read(filp, pos, (void *)mmc_data_ptr, length);
-#else  /* KERNEL_VERSION > 4,13,0) */
-                    transferred_bytes = kernel_read(filp, (void *)mmc_data_ptr, length, &pos);
-#endif /* LINUX_VERSION_CODE <= KERNEL_VERSION(4,13,0) */
-                }
-                if ((transferred_bytes > 0) && ((size_t) transferred_bytes == length)) {
-                    ret = 0;
+                    ret = mmcblk_merge_write(mmc_data_ptr, pos, length);
                 } else {
-                    ret = transferred_bytes?(int)transferred_bytes:-EACCES;
+                    /* Pending writes of the range go first */
+                    ret = mmcblk_merge_sync(pos, length);
+                    if (ret == 0) {
+                        ret = mmcblk_transfer(mmc_data_ptr, pos, length, false);
+                    }
                 }
-                filp_close(filp, 0);
             }
             break;
         default:
@@ -473,11 +1560,342 @@ static int mmcblk_remote_host(shdev_desc_t *desc_ptr)
     }
     return ret;
 }
+/* Handling MMC I/O rings --------------------------------------------------- */
+
+/** In flight MMC I/O request */
+struct mmcblk_io {
+    /* Node in completed requests list */
+    struct llist_node node;
+    /* Bios in flight, plus one held by submitter */
+    atomic_t pending;
+    /* First bio error */
+    int error;
+    /* Block cache generation when read was started */
+    unsigned long cache_gen;
+    /* Set once write was sent to device: block cache is told when it ends */
+    bool cache_write;
+    /* Request, as read from submission ring */
+    shdev_mmc_io_t req;
+};
+
+/** MMC I/O rings state */
+static struct {
+    /* Protects rings, busy and sq_head */
+    spinlock_t lock;
+    /* Rings in shdev SHM, NULL if stopped */
+    shdev_mmc_rings_t *rings;
+    /* MMC data buffer */
+    uint8_t *data;
+    uint32_t data_size;
+    /* Next submission slot to read, not trusting S view of it */
+    uint32_t sq_head;
+    /* Next completion slot to write, only updated by completion work */
+    uint32_t cq_tail;
+    /* In flight requests, slot set in busy if used */
+    struct mmcblk_io ios[SHDEV_MMC_RING_SLOTS];
+    DECLARE_BITMAP(busy, SHDEV_MMC_RING_SLOTS);
+    /* Requests ended, waiting for completion work */
+    struct llist_head done;
+    /* Woken up when last in flight request is completed */
+    wait_queue_head_t idle;
+} _mmc_io = {
+    .lock = __SPIN_LOCK_UNLOCKED(_mmc_io.lock),
+    .idle = __WAIT_QUEUE_HEAD_INITIALIZER(_mmc_io.idle),
+};
+
+static void mmcblk_io_submit_work_func(struct work_struct *work);
+static DECLARE_WORK(_mmc_io_submit_work, mmcblk_io_submit_work_func);
+static void mmcblk_io_complete_work_func(struct work_struct *work);
+static DECLARE_WORK(_mmc_io_complete_work, mmcblk_io_complete_work_func);
+
+static void mmcblk_io_put(struct mmcblk_io *io)
+{
+    if (atomic_dec_and_test(&io->pending)) {
+        llist_add(&io->node, &_mmc_io.done);
+        schedule_work(&_mmc_io_complete_work);
+    }
+}
+
+static void mmcblk_io_end(struct bio *bio)
+{
+    struct mmcblk_io *io = bio->bi_private;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,13,0)
+    int error = blk_status_to_errno(bio->bi_status);
+#else
+    int error = bio->bi_error;
+#endif
+
+    if (error != 0) {
+        cmpxchg(&io->error, 0, error);
+    }
+    bio_put(bio);
+    mmcblk_io_put(io);
+}
+
+/**
+ * @brief Start bios of MMC I/O request \p io.
+ *
+ * Request is ended at once if invalid.
+ */
+static void mmcblk_io_start(struct mmcblk_io *io)
+{
+    struct block_device *bdev = mmcblk_io_get();
+    shdev_mmc_io_t *req = &io->req;
+    bool write = (req->operation == WRITE_DEVICE);
+    unsigned int op = write ? REQ_OP_WRITE : REQ_OP_READ;
+    uint8_t *data = _mmc_io.data + req->data_offset;
+    size_t done = 0;
+    struct bio *bio;
+
+    atomic_set(&io->pending, 1);
+    io->error = 0;
+    io->cache_write = false;
+    if (IS_ERR(bdev)) {
+        io->error = PTR_ERR(bdev);
+        goto end;
+    }
+    if ((req->operation != READ_DEVICE && !write) ||
+        req->length > _mmc_io.data_size ||
+        req->data_offset > _mmc_io.data_size - req->length) {
+        pr_err("%s: invalid request %u: op=%u data_offset=%u length=%llu\n",
+            __func__, req->tag, req->operation, req->data_offset,
+            req->length);
+        io->error = -EINVAL;
+        goto end;
+    }
+    /* Bios would wait behind a suspended host, as for message operations */
+    io->error = shdev_mmc_host_get();
+    if (io->error != 0) {
+        goto end;
+    }
+    io->error = mmcblk_check_transfer(bdev, data, req->offset, req->length,
+        write);
+    if (io->error != 0) {
+        goto end;
+    }
+    /* Merged writes of the range go first */
+    io->error = mmcblk_merge_sync(req->offset, req->length);
+    if (io->error != 0) {
+        goto end;
+    }
+    if (write) {
+        mmcblk_cache_invalidate(req->offset, req->length);
+    } else if (mmcblk_cache_read(bdev, data, req->offset, req->length,
+            &io->cache_gen)) {
+        goto end;
+    }
+    io->error = mmcblk_sync(bdev, req->offset, req->length);
+    if (io->error != 0) {
+        goto end;
+    }
+
+    if (write) {
+        mmcblk_cache_write_start();
+        io->cache_write = true;
+    }
+    while (done < req->length) {
+        bio = mmcblk_bio_build(bdev, data, req->offset, req->length, &done,
+            op);
+        if (bio == NULL) {
+            io->error = -EIO;
+            break;
+        }
+        bio->bi_private = io;
+        bio->bi_end_io = mmcblk_io_end;
+        atomic_inc(&io->pending);
+        submit_bio(bio);
+    }
+end:
+    mmcblk_io_put(io);
+}
+
+/**
+ * @brief Start requests available in submission ring.
+ *
+ * Stops when no request slot is left: completion work kicks it again.
+ */
+static void mmcblk_io_submit_work_func(struct work_struct *work)
+{
+    shdev_mmc_rings_t *rings;
+    struct mmcblk_io *io;
+    struct blk_plug plug;
+    unsigned long flags;
+    unsigned int slot;
+    uint32_t tail;
+
+    (void)work;
+    blk_start_plug(&plug);
+    for (;;) {
+        spin_lock_irqsave(&_mmc_io.lock, flags);
+        rings = _mmc_io.rings;
+        if (rings == NULL) {
+            spin_unlock_irqrestore(&_mmc_io.lock, flags);
+            break;
+        }
+        tail = READ_ONCE(rings->sq_tail);
+        /* Read request after its index */
+        smp_rmb();
+        slot = find_first_zero_bit(_mmc_io.busy, SHDEV_MMC_RING_SLOTS);
+        /* A completion slot is left for each request taken */
+        if (tail == _mmc_io.sq_head || slot >= SHDEV_MMC_RING_SLOTS ||
+            _mmc_io.cq_tail - READ_ONCE(rings->cq_head) >=
+                SHDEV_MMC_RING_SLOTS - bitmap_weight(_mmc_io.busy,
+                    SHDEV_MMC_RING_SLOTS)) {
+            spin_unlock_irqrestore(&_mmc_io.lock, flags);
+            break;
+        }
+        set_bit(slot, _mmc_io.busy);
+        io = &_mmc_io.ios[slot];
+        memcpy(&io->req,
+            &rings->sq[_mmc_io.sq_head % SHDEV_MMC_RING_SLOTS],
+            sizeof(shdev_mmc_io_t));
+        _mmc_io.sq_head++;
+        WRITE_ONCE(rings->sq_head, _mmc_io.sq_head);
+        spin_unlock_irqrestore(&_mmc_io.lock, flags);
+
+        pr_debug("%s: %s: tag=%u offset=%llu length=%llu\n", __func__,
+            (io->req.operation == WRITE_DEVICE) ? "write":"read",
+            io->req.tag, io->req.offset, io->req.length);
+        mmcblk_io_start(io);
+    }
+    blk_finish_plug(&plug);
+}
+
+/**
+ * @brief Report ended requests into completion ring and signal S.
+ */
+static void mmcblk_io_complete_work_func(struct work_struct *work)
+{
+    struct llist_node *list = llist_del_all(&_mmc_io.done);
+    shdev_mmc_rings_t *rings;
+    struct mmcblk_io *io, *next;
+    shdev_mmc_cpl_t *cpl;
+    unsigned long flags;
+    bool idle = false;
+
+    (void)work;
+    if (list == NULL) {
+        return;
+    }
+    list = llist_reverse_order(list);
+    llist_for_each_entry_safe(io, next, list, node) {
+        if (io->cache_write) {
+            mmcblk_cache_write_end((io->error == 0) ? io->req.length : 0);
+        }
+        if (io->req.operation == WRITE_DEVICE && io->error == 0) {
+            mmcblk_invalidate(_shdev_mmc_io_bdev, io->req.offset,
+                io->req.length);
+        } else if (io->req.operation == READ_DEVICE && io->error == 0) {
+            mmcblk_cache_fill(_mmc_io.data + io->req.data_offset,
+                io->req.offset, io->req.length, io->cache_gen);
+        }
+        spin_lock_irqsave(&_mmc_io.lock, flags);
+        rings = _mmc_io.rings;
+        if (rings != NULL) {
+            cpl = &rings->cq[_mmc_io.cq_tail % SHDEV_MMC_RING_SLOTS];
+            cpl->tag = io->req.tag;
+            cpl->status = (io->error < 0) ? -io->error : io->error;
+            /* Write completion before its index */
+            smp_wmb();
+            _mmc_io.cq_tail++;
+            WRITE_ONCE(rings->cq_tail, _mmc_io.cq_tail);
+        }
+        clear_bit(io - _mmc_io.ios, _mmc_io.busy);
+        idle = bitmap_empty(_mmc_io.busy, SHDEV_MMC_RING_SLOTS);
+        spin_unlock_irqrestore(&_mmc_io.lock, flags);
+    }
+
+    if (READ_ONCE(_mmc_io.rings) != NULL) {
+        shdev_send_signal(SHDEV_SIGNAL(SIGNAL_MMC_IO));
+        /* Slots were freed */
+        schedule_work(&_mmc_io_submit_work);
+    }
+    if (idle) {
+        wake_up_all(&_mmc_io.idle);
+    }
+}
+
+void mmcblk_io_setup(shdev_mmc_rings_t *rings, shdev_desc_t *desc_ptr)
+{
+    unsigned long flags;
+
+    mmcblk_io_stop();
+    if (IS_ERR(mmcblk_io_get())) {
+        /* Rings not advertised: S sticks to READ/WRITE messages */
+        return;
+    }
+
+    memset(rings, 0, sizeof(shdev_mmc_rings_t));
+    rings->num_slots = SHDEV_MMC_RING_SLOTS;
+    spin_lock_irqsave(&_mmc_io.lock, flags);
+    _mmc_io.data = (uint8_t *)(_shdev_shm_addr + desc_ptr->data_offset);
+    _mmc_io.data_size = desc_ptr->data_size;
+    _mmc_io.sq_head = 0;
+    _mmc_io.cq_tail = 0;
+    _mmc_io.rings = rings;
+    spin_unlock_irqrestore(&_mmc_io.lock, flags);
+    /* Magic set last: rings are ready */
+    smp_wmb();
+    WRITE_ONCE(rings->magic, SHDEV_MAGIC_MMC_RINGS);
+}
+
+void mmcblk_io_kick(void)
+{
+    schedule_work(&_mmc_io_submit_work);
+}
+
+void mmcblk_io_stop(void)
+{
+    unsigned long flags;
+
+    spin_lock_irqsave(&_mmc_io.lock, flags);
+    if (_mmc_io.rings != NULL) {
+        WRITE_ONCE(_mmc_io.rings->magic, 0);
+    }
+    WRITE_ONCE(_mmc_io.rings, NULL);
+    spin_unlock_irqrestore(&_mmc_io.lock, flags);
+
+    /* No new request once submission work is done: wait in flight ones */
+    cancel_work_sync(&_mmc_io_submit_work);
+    wait_event(_mmc_io.idle, bitmap_empty(_mmc_io.busy, SHDEV_MMC_RING_SLOTS));
+    flush_work(&_mmc_io_complete_work);
+    /* Completion work may have queued submission work again meanwhile */
+    cancel_work_sync(&_mmc_io_submit_work);
+}
+
+/* END Handling MMC I/O rings ----------------------------------------------- */
+
 #endif /* CONFIG_PROVENCORE_MMC_REMOTE_HOST */
 
+static void mmcblk_release(void)
+{
+    /* Linux requests must not stay held: device was taken if held */
+    mmcblk_arb_give(_shdev_mmc_bdev);
+    mmcblk_cache_clear();
+#ifdef CONFIG_PROVENCORE_MMC_REMOTE_HOST
+    mmcblk_io_stop();
+    mmcblk_merge_release();
+#ifdef CONFIG_PROVENCORE_MMC_USE_RPMB
+    mmcblk_rpmb_release();
+#endif
+    if (_shdev_mmc_io_bdev != NULL) {
+        blkdev_put(_shdev_mmc_io_bdev, MMC_IO_FMODE);
+        _shdev_mmc_io_bdev = NULL;
+    }
+#endif
+    if (_shdev_mmc_bdev != NULL) {
+        blkdev_put(_shdev_mmc_bdev, FMODE_PATH);
+        _shdev_mmc_bdev = NULL;
+    }
+}
+
 static shdev_ops_t mmcblk_ops = {
     .suspend = mmcblk_suspend,
     .resume  = mmcblk_resume,
+#ifdef CONFIG_PROVENCORE_MMC_ARBITRATION
+    .hold_expired = mmcblk_hold_expired,
+#endif
+    .release = mmcblk_release,
 #ifdef CONFIG_PROVENCORE_MMC_REMOTE_HOST
     .select  = mmcblk_remote_host,
     .read    = mmcblk_remote_host,
@@ -485,6 +1903,7 @@ static shdev_ops_t mmcblk_ops = {
 #ifdef CONFIG_PROVENCORE_MMC_USE_RPMB
     .rpmb    = mmcblk_remote_host,
 #endif /* CONFIG_PROVENCORE_MMC_USE_RPMB */
+    .flush   = mmcblk_remote_flush,
 #endif
 };
 
@@ -29,12 +29,30 @@
 #include <linux/err.h>
 #include <linux/delay.h>        // msleep()
 #include <linux/kthread.h>
+#include <linux/mutex.h>
 
 /* Shared device(s) monitor is a ree session user...*/
 #include "misc/provencore/ree_session.h"
 
 #include "internal.h"
 
+#ifdef CONFIG_PROVENCORE_MMC_REMOTE_HOST
+#ifndef CONFIG_PROVENCORE_MMC_DATA_PAGES
+#define CONFIG_PROVENCORE_MMC_DATA_PAGES SHDEV_MMC_PAGES
+#endif
+#if CONFIG_PROVENCORE_MMC_DATA_PAGES < SHDEV_MMC_PAGES
+#error "CONFIG_PROVENCORE_MMC_DATA_PAGES below SHDEV_MMC_PAGES"
+#endif
+#endif
+
+#ifndef CONFIG_PROVENCORE_SHDEV_MAX_ACTIVE
+#define CONFIG_PROVENCORE_SHDEV_MAX_ACTIVE NUM_DEVICES
+#endif
+
+#ifndef CONFIG_PROVENCORE_SHDEV_LEASE_MS
+#define CONFIG_PROVENCORE_SHDEV_LEASE_MS 20
+#endif
+
 /* Internal device descriptor */
 typedef struct shdev {
     /* Scheduled work */
@@ -45,8 +63,22 @@ typedef struct shdev {
     uint32_t signal_msg;
     /* Device operations */
     shdev_ops_t *ops;
+    /* Server side of device operation ring, only used by work */
+    shdev_op_ring_server_t queue;
+    /* Protects lease state below */
+    struct mutex lease_lock;
+    /* Set while device is suspended for S */
+    bool leased;
+    /* Set while device is resumed by S, but not given back to Linux yet */
+    bool releasing;
+    /* Gives device back to Linux once lease grace period is over */
+    struct delayed_work release_work;
 } shdev_t;
 
+/** Workqueue running devices works: operations of a device are handled in
+ * order, devices are handled concurrently */
+static struct workqueue_struct *_shdev_wq = NULL;
+
 /** Start addr for shdev session's SHM */
 char *_shdev_shm_addr = NULL;
 
@@ -59,40 +91,167 @@ static shdev_infos_t *_shdev_infos_ptr = NULL;
 /** Table of internal device descriptors */
 static shdev_t _shdev_devices[NUM_DEVICES];
 
-static void device_work_func(struct work_struct *work)
+int shdev_send_signal(uint32_t bits)
+{
+    return pnc_session_send_signal(_shdev_session, bits);
+}
+
+/**
+ * S is going to use device: suspend it for Linux, unless lease is still held
+ * because S resumed it shortly before
+ */
+static int device_lease_take(shdev_t *dev_ptr, uint32_t index)
 {
     int ret = 0;
-    uint32_t index;
-    shdev_t *dev_ptr;
-    shdev_desc_t desc;
-    shdev_message_t *mptr;
 
-    /* Get internal device descriptor */
-    dev_ptr = container_of(work, shdev_t, work);
-    index = SHDEV_ID_TO_DEVICE(dev_ptr->id);
-    if (index >= NUM_DEVICES) {
-        pr_err("invalid work !\n");
-        return;
+    mutex_lock(&dev_ptr->lease_lock);
+    if (dev_ptr->releasing && dev_ptr->ops->hold_expired &&
+        dev_ptr->ops->hold_expired()) {
+        /* Lease not renewed: Linux gets device back first */
+        pr_debug("lease expired %u\n", index);
+        cancel_delayed_work(&dev_ptr->release_work);
+        ret = dev_ptr->ops->resume();
+        if (ret != 0) {
+            pr_err("resume failure for device %u (%d)\n", index, ret);
+        }
+        dev_ptr->releasing = false;
+        dev_ptr->leased = false;
+        ret = 0;
+    }
+    if (dev_ptr->releasing) {
+        /* Resume and suspend coalesced */
+        pr_debug("lease renewed %u\n", index);
+        dev_ptr->releasing = false;
+        cancel_delayed_work(&dev_ptr->release_work);
+    } else if (!dev_ptr->leased) {
+        pr_debug("suspend %u\n", index);
+        ret = dev_ptr->ops->suspend();
+        dev_ptr->leased = (ret == 0);
+    }
+    mutex_unlock(&dev_ptr->lease_lock);
+    return ret;
+}
+
+/**
+ * Resume device for Linux if still released by S
+ */
+static int device_lease_expire(shdev_t *dev_ptr)
+{
+    int ret = 0;
+    uint32_t index = SHDEV_ID_TO_DEVICE(dev_ptr->id);
+
+    mutex_lock(&dev_ptr->lease_lock);
+    if (dev_ptr->releasing) {
+        pr_debug("resume %u\n", index);
+        ret = dev_ptr->ops->resume();
+        if (ret != 0) {
+            pr_err("resume failure for device %u (%d)\n", index, ret);
+        }
+        dev_ptr->releasing = false;
+        dev_ptr->leased = false;
+    }
+    mutex_unlock(&dev_ptr->lease_lock);
+    return ret;
+}
+
+static void device_release_work_func(struct work_struct *work)
+{
+    shdev_t *dev_ptr = container_of(to_delayed_work(work), shdev_t,
+            release_work);
+
+    device_lease_expire(dev_ptr);
+}
+
+/**
+ * S ended up with device usage: give it back to Linux once lease grace period
+ * is over, status of deferred resume is only logged
+ */
+static int device_lease_return(shdev_t *dev_ptr, uint32_t index)
+{
+    unsigned long grace = msecs_to_jiffies(CONFIG_PROVENCORE_SHDEV_LEASE_MS);
+    int ret = 0;
+
+    mutex_lock(&dev_ptr->lease_lock);
+    if (grace == 0 || !dev_ptr->ops->suspend) {
+        /* No lease: resume at once */
+        pr_debug("resume %u\n", index);
+        ret = dev_ptr->ops->resume();
+        dev_ptr->leased = false;
+    } else if (!dev_ptr->releasing) {
+        dev_ptr->releasing = true;
+        queue_delayed_work(_shdev_wq, &dev_ptr->release_work, grace);
+    }
+    mutex_unlock(&dev_ptr->lease_lock);
+    return ret;
+}
+
+/**
+ * Remote operations go through Linux driver: device must be resumed. A lease
+ * in its grace period is ended at once, one still held by S fails them.
+ */
+static int device_host_get(shdev_t *dev_ptr, uint32_t index)
+{
+    int ret;
+
+    if (index != MMC_DEVICE) {
+        return 0;
     }
+    ret = device_lease_expire(dev_ptr);
+    if (ret != 0) {
+        return ret;
+    }
+    mutex_lock(&dev_ptr->lease_lock);
+    if (dev_ptr->leased) {
+        pr_err("device %u suspended by S\n", index);
+        ret = -EBUSY;
+    }
+    mutex_unlock(&dev_ptr->lease_lock);
+    return ret;
+}
+
+#ifdef CONFIG_PROVENCORE_MMC_REMOTE_HOST
+int shdev_mmc_host_get(void)
+{
+    return device_host_get(&_shdev_devices[MMC_DEVICE], MMC_DEVICE);
+}
+#endif /* CONFIG_PROVENCORE_MMC_REMOTE_HOST */
+
+/**
+ * Run operation \p msg on device \p dev_ptr
+ *
+ * @return operation status
+ */
+static int device_run(shdev_t *dev_ptr, uint32_t index,
+    const shdev_message_t *msg)
+{
+    int ret = 0;
+    shdev_desc_t desc;
 
     /* Copy shared device descriptor */
     memcpy(&desc, &_shdev_infos_ptr->descriptors[index], sizeof(shdev_desc_t));
     if (desc.id != dev_ptr->id) {
         pr_err("invalid device descriptor (%u/%u) !\n", desc.id, dev_ptr->id);
-        return;
+        return -EINVAL;
+    }
+    memcpy(&desc.s_to_ns, msg, sizeof(shdev_message_t));
+
+    if (desc.s_to_ns.operation != SUSPEND_DEVICE &&
+        desc.s_to_ns.operation != RESUME_DEVICE) {
+        ret = device_host_get(dev_ptr, index);
+        if (ret != 0) {
+            return ret;
+        }
     }
 
     switch(desc.s_to_ns.operation) {
         case SUSPEND_DEVICE:
             if (dev_ptr->ops->suspend) {
-                pr_debug("suspend %u\n", index);
-                ret = dev_ptr->ops->suspend();
+                ret = device_lease_take(dev_ptr, index);
             }
             break;
         case RESUME_DEVICE:
             if (dev_ptr->ops->resume) {
-                pr_debug("resume %u\n", index);
-                ret = dev_ptr->ops->resume();
+                ret = device_lease_return(dev_ptr, index);
             }
             break;
         case SELECT_DEVICE:
@@ -121,6 +280,12 @@ static void device_work_func(struct work_struct *work)
             }
             break;
 #endif /* CONFIG_PROVENCORE_MMC_USE_RPMB */
+        case FLUSH_DEVICE:
+            if (dev_ptr->ops->flush) {
+                pr_debug("flush %u\n", index);
+                ret = dev_ptr->ops->flush(&desc);
+            }
+            break;
         default:
             pr_err("%s: unhandled operation %u\n", __func__,
                 desc.s_to_ns.operation);
@@ -128,63 +293,105 @@ static void device_work_func(struct work_struct *work)
             break;
     }
 
-    /* Signal S about new operation status: copy NS->S in S->NS msg slot and
-     * update it with operation status. */
-    mptr = &_shdev_infos_ptr->descriptors[index].ns_to_s;
-    memcpy(mptr, &desc.s_to_ns, sizeof(shdev_message_t));
-    mptr->status = 1;
-    mptr->value = (ret < 0) ? -ret:ret;
-    ret = pnc_session_send_signal(_shdev_session, dev_ptr->signal_msg);
-    if (ret != 0) {
-        /* Leaving thread... */
-        pr_err("Shared devices monitor synchro failure (%d).\n", ret);
-        // TODO: handle this use case ?
+    return ret;
+}
+
+/**
+ * Handle all pending operations of a device: queued ones first, then the one
+ * in S->NS message slot if any
+ */
+static void device_work_func(struct work_struct *work)
+{
+    int ret = 0;
+    uint32_t index;
+    shdev_t *dev_ptr;
+    shdev_message_t msg;
+    shdev_message_t *mptr;
+    bool notify = false;
+
+    /* Get internal device descriptor */
+    dev_ptr = container_of(work, shdev_t, work);
+    index = SHDEV_ID_TO_DEVICE(dev_ptr->id);
+    if (index >= NUM_DEVICES) {
+        pr_err("invalid work !\n");
+        return;
+    }
+
+    /* Operation ring: one response per request, in order */
+    while (shdev_op_ring_server_checkout(&dev_ptr->queue)) {
+        while (shdev_op_ring_server_consume(&dev_ptr->queue, &msg)) {
+            ret = device_run(dev_ptr, index, &msg);
+            msg.status = 1;
+            msg.value = (ret < 0) ? -ret:ret;
+            shdev_op_ring_server_produce(&dev_ptr->queue, &msg);
+        }
+        if (shdev_op_ring_server_commit(&dev_ptr->queue)) {
+            notify = true;
+        }
+    }
+
+    /* Message slot: status is set once request is taken, so that it is
+     * handled once only */
+    mptr = &_shdev_infos_ptr->descriptors[index].s_to_ns;
+    if (READ_ONCE(mptr->status) == 0) {
+        memcpy(&msg, mptr, sizeof(shdev_message_t));
+        WRITE_ONCE(mptr->status, 1);
+        ret = device_run(dev_ptr, index, &msg);
+
+        /* Signal S about new operation status: copy NS->S in S->NS msg slot
+         * and update it with operation status. */
+        mptr = &_shdev_infos_ptr->descriptors[index].ns_to_s;
+        memcpy(mptr, &msg, sizeof(shdev_message_t));
+        mptr->status = 1;
+        mptr->value = (ret < 0) ? -ret:ret;
+        notify = true;
+    }
+
+    if (notify) {
+        ret = pnc_session_send_signal(_shdev_session, dev_ptr->signal_msg);
+        if (ret != 0) {
+            pr_err("Shared devices monitor synchro failure (%d).\n", ret);
+            // TODO: handle this use case ?
+        }
     }
 
     return;
 }
 
 /**
- * Handle reception of S-->NS signal
+ * Handle reception of S-->NS signal, called from REE notification path
  *
  * If signal doesn't indicate new SIGNAL_xxx_MESSAGE, it is ignored.
  * Upon new SIGNAL_xxx_MESSAGE reception, schedule corresponding device handler.
  */
-static void handle_signal(void)
+static void handle_signal(pnc_session_t *session, uint32_t signals, void *ctx)
 {
-    int ret;
-    uint32_t signals;
-
-    ret = pnc_session_get_signal(_shdev_session, &signals);
-    if (ret != 0) {
-        pr_err("failed to get received signals (%d)\n", ret);
-        return;
-    }
+    (void)session;
+    (void)ctx;
 
 #ifdef CONFIG_PROVENCORE_SHARED_MMC
     if (signals & SHDEV_SIGNAL(SIGNAL_MMC_MESSAGE)) {
-        /* Schedule MMC work */
-        if (!schedule_work(&_shdev_devices[MMC_DEVICE].work)) {
-            pr_warn("MMC job is already running\n");
-        }
+        /* Schedule MMC work: it handles all pending operations */
+        queue_work(_shdev_wq, &_shdev_devices[MMC_DEVICE].work);
     }
+#ifdef CONFIG_PROVENCORE_MMC_REMOTE_HOST
+    if (signals & SHDEV_SIGNAL(SIGNAL_MMC_IO)) {
+        mmcblk_io_kick();
+    }
+#endif
 #endif
 
 #ifdef CONFIG_PROVENCORE_SHARED_ENET
     if (signals & SHDEV_SIGNAL(SIGNAL_ENET_MESSAGE)) {
-        /* Schedule ENET work */
-        if (!schedule_work(&_shdev_devices[ENET_DEVICE].work)) {
-            pr_warn("ENET job is already running\n");
-        }
+        /* Schedule ENET work: it handles all pending operations */
+        queue_work(_shdev_wq, &_shdev_devices[ENET_DEVICE].work);
     }
 #endif
 
 #ifdef CONFIG_PROVENCORE_SHARED_SPI
     if (signals & SHDEV_SIGNAL(SIGNAL_SPI_MESSAGE)) {
-        /* Schedule SPI work */
-        if (!schedule_work(&_shdev_devices[SPI_DEVICE].work)) {
-            pr_warn("SPI job is already running\n");
-        }
+        /* Schedule SPI work: it handles all pending operations */
+        queue_work(_shdev_wq, &_shdev_devices[SPI_DEVICE].work);
     }
 #endif
 
@@ -204,7 +411,9 @@ static int configure(void)
     int ret;
     unsigned long shm_size;
     uint32_t session_pages=SHDEV_PAGES, data_offset=0, infos_offset=0, version;
+    uint32_t mmc_pages=0, index;
     shdev_desc_t *desc_ptr;
+    shdev_op_ring_t *ring;
 
     pr_debug("opening shared devices monitor session\n");
     ret = pnc_session_open(&_shdev_session);
@@ -214,11 +423,18 @@ static int configure(void)
     }
 
 #ifdef CONFIG_PROVENCORE_MMC_REMOTE_HOST
-    session_pages += SHDEV_MMC_PAGES;
+    mmc_pages = CONFIG_PROVENCORE_MMC_DATA_PAGES;
 #endif
 
     pr_debug("allocating shm for shared devices monitor session\n");
-    ret = pnc_session_alloc(_shdev_session, session_pages*PAGE_SIZE);
+    ret = pnc_session_alloc(_shdev_session,
+            (session_pages + mmc_pages)*PAGE_SIZE);
+    while ((ret == -ENOMEM) && (mmc_pages > SHDEV_MMC_PAGES)) {
+        /* SHM too fragmented for the whole MMC data window: shrink it */
+        mmc_pages = max_t(uint32_t, mmc_pages / 2, SHDEV_MMC_PAGES);
+        ret = pnc_session_alloc(_shdev_session,
+                (session_pages + mmc_pages)*PAGE_SIZE);
+    }
     if (ret != 0) {
         pr_err("alloc failure for shared devices monitor (%d)\n", ret);
         goto config_err;
@@ -263,6 +479,7 @@ session_config:
     /* Setup generic shdev _shdev_infos */
     _shdev_infos_ptr = (shdev_infos_t *)((void *)_shdev_shm_addr);
     _shdev_infos_ptr->magic = SHDEV_MAGIC_INFOS;
+    _shdev_infos_ptr->mmc_features = 0;
     _shdev_infos_ptr->num_devices = NUM_DEVICES;
     data_offset  = SHDEV_PAGES*PAGE_SIZE;
     infos_offset = sizeof(shdev_infos_t);
@@ -274,14 +491,28 @@ session_config:
 #ifdef CONFIG_PROVENCORE_MMC_REMOTE_HOST
     /* Setup MMC remote host layout:
      *  - entry buffer used for additional device description
-     *  - data buffer used for read/write ops. Starts after \p SHDEV_PAGES
+     *  - data buffer used for read/write ops. Starts after \p SHDEV_PAGES,
+     *    its size tells S the max length of a single transfer
      */
     desc_ptr->entry_offset = infos_offset;
     desc_ptr->entry_size   = sizeof(shdev_mmc_entry_t);
+    /* Fields unknown to S stay 0 */
+    memset(_shdev_shm_addr + desc_ptr->entry_offset, 0, desc_ptr->entry_size);
     infos_offset += desc_ptr->entry_size;
     desc_ptr->data_offset = data_offset;
-    desc_ptr->data_size   = SHDEV_MMC_PAGES*PAGE_SIZE;
+    desc_ptr->data_size   = mmc_pages*PAGE_SIZE;
     data_offset += desc_ptr->data_size;
+    pr_info("MMC data window: %u pages\n", mmc_pages);
+    /* MMC I/O rings share the data buffer with READ/WRITE messages */
+    infos_offset = ALIGN(infos_offset, sizeof(uint64_t));
+    _shdev_infos_ptr->mmc_rings_offset = infos_offset;
+    infos_offset += sizeof(shdev_mmc_rings_t);
+#ifdef CONFIG_PROVENCORE_MMC_PARTITION_SHARING
+    _shdev_infos_ptr->mmc_features |= SHDEV_MMC_FEATURE_PART_SHARING;
+#endif
+#ifdef CONFIG_PROVENCORE_MMC_USE_RPMB
+    _shdev_infos_ptr->mmc_features |= SHDEV_MMC_FEATURE_RPMB_FRAMES;
+#endif
 #endif /* CONFIG_PROVENCORE_MMC_REMOTE_HOST */
 #endif /* CONFIG_PROVENCORE_SHARED_MMC */
 
@@ -297,6 +528,11 @@ session_config:
     desc_ptr->id = SHDEV_DEVICE_TO_ID(SPI_DEVICE);
 #endif
 
+    /* Operation rings, one per device */
+    infos_offset = ALIGN(infos_offset, sizeof(uint64_t));
+    _shdev_infos_ptr->op_rings_offset = infos_offset;
+    infos_offset += NUM_DEVICES * sizeof(shdev_op_ring_t);
+
     /* Check shdev infos and data fit in reserved area */
     if (infos_offset > SHDEV_PAGES*PAGE_SIZE) {
         pr_err("Invalid shared devices infos layout [1]: %u/%lu\n", infos_offset,
@@ -311,6 +547,30 @@ session_config:
         goto config_err;
     }
 
+    for (index = 0; index < NUM_DEVICES; index++) {
+        ring = (shdev_op_ring_t *)(_shdev_shm_addr +
+                _shdev_infos_ptr->op_rings_offset) + index;
+        shdev_op_ring_shared_init(&ring->shared);
+        shdev_op_ring_server_init(&_shdev_devices[index].queue, &ring->shared,
+                sizeof(shdev_op_ring_t));
+        /* No pending request in message slot */
+        _shdev_infos_ptr->descriptors[index].s_to_ns.status = 1;
+    }
+
+#ifdef CONFIG_PROVENCORE_MMC_REMOTE_HOST
+    mmcblk_io_setup((shdev_mmc_rings_t *)(_shdev_shm_addr +
+            _shdev_infos_ptr->mmc_rings_offset),
+            &_shdev_infos_ptr->descriptors[MMC_DEVICE]);
+#endif
+
+    /* Get S signals straight from REE notification path */
+    ret = pnc_session_register_signal_handler(_shdev_session, ~UINT32_C(0),
+            handle_signal, NULL);
+    if (ret != 0) {
+        pr_err("Shared devices monitor signal handler failure (%d).\n", ret);
+        goto config_err;
+    }
+
     /* Signal S about monitor readiness */
     pr_info("Signalling shared devices monitor readiness.\n");
     ret = pnc_session_send_signal(_shdev_session, SHDEV_SIGNAL(SIGNAL_READY));
@@ -322,6 +582,10 @@ session_config:
     return 0;
 
 config_err:
+#ifdef CONFIG_PROVENCORE_MMC_REMOTE_HOST
+    mmcblk_io_stop();
+#endif
+    flush_workqueue(_shdev_wq);
     pnc_session_close(_shdev_session);
     return ret;
 }
@@ -330,7 +594,8 @@ config_err:
  * Shared devices monitor thread
  *
  * Responsible for configuring session with SID_DEVMON at startup and then to
- * keep waiting for S requests to suspend or resume any supported device.
+ * keep watching it, restarting it if terminated. S requests to suspend or
+ * resume any supported device are signals, handled by \ref handle_signal.
  */
 static int shdev_thread(void *arg)
 {
@@ -374,15 +639,20 @@ monitor_restart:
         if (kthread_should_stop())
             break;
 
-        /* Wait for S monitor event: only signal or request. Response shall be
-         * retreived separately if sending a request...
+        /* Wait for S monitor event: only request, signals are handled by
+         * handle_signal. Response shall be retreived separately if sending a
+         * request...
          */
         ret = pnc_session_wait_event(_shdev_session, &events,
-                EVENT_PENDING_SIGNAL|EVENT_PENDING_REQUEST, NO_TIMEOUT);
+                EVENT_PENDING_REQUEST, NO_TIMEOUT);
         if (ret != 0) {
             if (ret == -ENODEV) {
                 /* Session not ready anymore... Terminate... */
                 pr_err("%s: session not functional anymore...\n", __func__);
+#ifdef CONFIG_PROVENCORE_MMC_REMOTE_HOST
+                mmcblk_io_stop();
+#endif
+                flush_workqueue(_shdev_wq);
                 pnc_session_close(_shdev_session);
                 /* ...and get ready for new one... */
                 goto monitor_restart;
@@ -401,9 +671,6 @@ monitor_restart:
         if (events & EVENT_PENDING_REQUEST) {
             pr_err("%s: request reception not supported\n", __func__);
         }
-        if (events & EVENT_PENDING_SIGNAL) {
-            handle_signal();
-        }
     } while (1);
 
     /* Should never get there */
@@ -420,23 +687,39 @@ static int __init shdev_init(void)
     _shdev_devices[MMC_DEVICE].signal_msg = SHDEV_SIGNAL(SIGNAL_MMC_MESSAGE);
     _shdev_devices[MMC_DEVICE].ops = mmcblk_init();
     INIT_WORK(&_shdev_devices[MMC_DEVICE].work, device_work_func);
+    mutex_init(&_shdev_devices[MMC_DEVICE].lease_lock);
+    INIT_DELAYED_WORK(&_shdev_devices[MMC_DEVICE].release_work,
+            device_release_work_func);
 #endif
 #ifdef CONFIG_PROVENCORE_SHARED_ENET
     _shdev_devices[ENET_DEVICE].id  = SHDEV_DEVICE_TO_ID(ENET_DEVICE);
     _shdev_devices[ENET_DEVICE].signal_msg = SHDEV_SIGNAL(SIGNAL_ENET_MESSAGE);
     _shdev_devices[ENET_DEVICE].ops = enetdev_init();
     INIT_WORK(&_shdev_devices[ENET_DEVICE].work, device_work_func);
+    mutex_init(&_shdev_devices[ENET_DEVICE].lease_lock);
+    INIT_DELAYED_WORK(&_shdev_devices[ENET_DEVICE].release_work,
+            device_release_work_func);
 #endif
 #ifdef CONFIG_PROVENCORE_SHARED_SPI
     _shdev_devices[SPI_DEVICE].id  = SHDEV_DEVICE_TO_ID(SPI_DEVICE);
     _shdev_devices[SPI_DEVICE].signal_msg = SHDEV_SIGNAL(SIGNAL_SPI_MESSAGE);
     _shdev_devices[SPI_DEVICE].ops = spidev_init();
     INIT_WORK(&_shdev_devices[SPI_DEVICE].work, device_work_func);
+    mutex_init(&_shdev_devices[SPI_DEVICE].lease_lock);
+    INIT_DELAYED_WORK(&_shdev_devices[SPI_DEVICE].release_work,
+            device_release_work_func);
 #endif
 
+    _shdev_wq = alloc_workqueue("pnc_shdev", WQ_MEM_RECLAIM,
+            CONFIG_PROVENCORE_SHDEV_MAX_ACTIVE);
+    if (_shdev_wq == NULL) {
+        return -ENOMEM;
+    }
+
     /* Create and start shared devices monitor kthread */
     shdev_task = kthread_create(&shdev_thread, NULL, "pnc_shdev");
     if (IS_ERR(shdev_task)) {
+        destroy_workqueue(_shdev_wq);
         return PTR_ERR(shdev_task);
     }
     kthread_bind(shdev_task, 0); /* bind to cpu#0 */
@@ -446,6 +729,14 @@ static int __init shdev_init(void)
 
 static void __exit shdev_exit(void)
 {
+    uint32_t index;
+
+#ifdef CONFIG_PROVENCORE_MMC_REMOTE_HOST
+    /* MMC I/O in flight use session SHM */
+    mmcblk_io_stop();
+#endif
+    flush_workqueue(_shdev_wq);
+
     /* Close session with secure shared devices monitor */
     if (_shdev_session) {
         pr_debug("Closing monitor session\n");
@@ -456,16 +747,22 @@ static void __exit shdev_exit(void)
     pr_debug("Stopping monitor process\n");
     kthread_stop(shdev_task);
 
-    /* Wait end of any shared device pending work */
-#ifdef CONFIG_PROVENCORE_SHARED_MMC
-    flush_work(&_shdev_devices[MMC_DEVICE].work);
-#endif
-#ifdef CONFIG_PROVENCORE_SHARED_ENET
-    flush_work(&_shdev_devices[ENET_DEVICE].work);
-#endif
-#ifdef CONFIG_PROVENCORE_SHARED_SPI
-    flush_work(&_shdev_devices[SPI_DEVICE].work);
-#endif
+    /* Give back devices still leased by S, then wait end of any shared
+     * device pending work */
+    for (index = 0; index < NUM_DEVICES; index++) {
+        if (_shdev_devices[index].ops) {
+            cancel_delayed_work_sync(&_shdev_devices[index].release_work);
+            device_lease_expire(&_shdev_devices[index]);
+        }
+    }
+    destroy_workqueue(_shdev_wq);
+
+    /* No more work: release devices */
+    for (index = 0; index < NUM_DEVICES; index++) {
+        if (_shdev_devices[index].ops && _shdev_devices[index].ops->release) {
+            _shdev_devices[index].ops->release();
+        }
+    }
     pr_info("module exit.\n");
 }
 
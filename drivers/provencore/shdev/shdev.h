@@ -28,6 +28,8 @@
 #include <string.h>
 #endif
 
+#include "misc/provencore/pnr_ring.h"
+
 /* Shared device(s) monitor is responsible for handling of device(s) shared
  * between S and NS.
  *
@@ -61,13 +63,29 @@
  * S may not wait for operation's status before using shared device or sending
  * new signal.
  *
+ * Instead of the single message slots of a device descriptor, S can queue
+ * operations into the device's operation ring (see \ref shdev_op_ring_t), a
+ * bidirectional ring where S is client and NS is server: NS handles queued
+ * operations in order and answers each one with its status. Operations using
+ * the device's entry or data buffer still need S to wait for their status
+ * before queueing another one.
+ *
+ * Remote MMC read/write requests can also go through a pair of MMC I/O rings
+ * (see \ref shdev_mmc_rings_t), allowing several requests in flight:
+ *  - S pushes requests into submission ring, then sends SIGNAL_MMC_IO
+ *  - NS starts them as they come, and pushes their status into completion
+ *    ring as they end, possibly out of order
+ *  - NS sends SIGNAL_MMC_IO when new completions are available
+ *
  */
 
 /** Num of PAGE_SIZE pages used to shared device monitor's infos & messages */
 #define SHDEV_PAGES    1
 
-/** Num of PAGE_SIZE pages used to shared device monitor's for remote MMC feature
- * handling (e.g used only if CONFIG_PROVENCORE_MMC_REMOTE_HOST defined)
+/** Min num of PAGE_SIZE pages used to shared device monitor's for remote MMC
+ * feature handling (e.g used only if CONFIG_PROVENCORE_MMC_REMOTE_HOST defined).
+ * Actual size of the MMC data buffer is set by NS in MMC descriptor's
+ * data_size: S shall not issue a read/write request larger than it.
  */
 #define SHDEV_MMC_PAGES    1
 
@@ -88,6 +106,16 @@ enum shdev_signals {
     /* Indicate NS and S that new S, respectively NS, SPI message is available */
     SIGNAL_SPI_MESSAGE,
 
+    /* Indicate NS that new MMC I/O requests are available or that completions
+     * were consumed, and S that new MMC I/O completions are available
+     */
+    SIGNAL_MMC_IO,
+
+    /* Indicate S that it holds MMC for more than NS max hold time, and
+     * should resume it as soon as possible
+     */
+    SIGNAL_MMC_YIELD,
+
     /* No signal value upon this limit: signals for a session are using a 32-bit
      * integer register. hence this 32 limitation for the max num of different
      * type of signals S and NS can share.
@@ -121,6 +149,9 @@ enum shdev_operations {
     READ_DEVICE,
     WRITE_DEVICE,
     RPMB_DEVICE,
+    /* Make writes acknowledged so far durable: NS may acknowledge a write
+     * before it reaches the device */
+    FLUSH_DEVICE,
 
     /* Limit value for an operation, given it is encoded into uint16_t... */
     INVALID_OPERATION=0x10000
@@ -141,8 +172,67 @@ typedef struct mmc_infos {
     uint64_t offset;
     /* Size of data */
     uint64_t length;
+    /* Num of data frames of a RPMB read or write request, 0 for a single
+     * one. Only used if NS supports SHDEV_MMC_FEATURE_RPMB_FRAMES, left to 0
+     * otherwise.
+     */
+    uint32_t rpmb_frames;
 } shdev_mmc_entry_t;
 
+/** Num of slots of each MMC I/O ring: a power of 2 */
+#define SHDEV_MMC_RING_SLOTS    32
+
+/** MMC I/O request, set by S into submission ring */
+typedef struct shdev_mmc_io {
+    /* Request identifier chosen by S, reported back in completion */
+    uint32_t tag;
+    /* READ_DEVICE or WRITE_DEVICE */
+    uint16_t operation;
+    /* Reserved, set to 0 */
+    uint16_t reserved;
+    /* Offset of data in MMC data buffer */
+    uint32_t data_offset;
+    /* Reserved, set to 0 */
+    uint32_t reserved2;
+    /* Offset in user partition */
+    uint64_t offset;
+    /* Size of data */
+    uint64_t length;
+} shdev_mmc_io_t;
+
+/** MMC I/O completion, set by NS into completion ring */
+typedef struct shdev_mmc_cpl {
+    /* Tag of completed request */
+    uint32_t tag;
+    /* 0 on success, positive error code otherwise */
+    uint32_t status;
+} shdev_mmc_cpl_t;
+
+/** MMC I/O rings. Indexes are free running, slot of index i is
+ * i % SHDEV_MMC_RING_SLOTS. S shall not have more than num_slots requests
+ * submitted and not consumed from completion ring: NS stops taking requests
+ * until it is the case.
+ */
+#define SHDEV_MAGIC_MMC_RINGS   UINT32_C(0xabeef002)
+typedef struct shdev_mmc_rings {
+    /* Magic, set by NS once rings are ready */
+    uint32_t magic;
+    /* Num of slots of each ring */
+    uint32_t num_slots;
+    /* Next submission slot read by NS */
+    uint32_t sq_head;
+    /* Next submission slot written by S */
+    uint32_t sq_tail;
+    /* Next completion slot read by S */
+    uint32_t cq_head;
+    /* Next completion slot written by NS */
+    uint32_t cq_tail;
+    /* Submission ring */
+    shdev_mmc_io_t sq[SHDEV_MMC_RING_SLOTS];
+    /* Completion ring */
+    shdev_mmc_cpl_t cq[SHDEV_MMC_RING_SLOTS];
+} shdev_mmc_rings_t;
+
 /** Description of a message shared between S and NS at runtime */
 typedef struct shdev_message {
     /* Operation requested on shared device (see \ref enum shdev_operations) */
@@ -157,6 +247,32 @@ typedef struct shdev_message {
     uint16_t value;
 } shdev_message_t;
 
+/** Num of slots of a device operation ring: a power of 2 */
+#define SHDEV_OP_RING_SLOTS    8
+
+/** Generate API for device operation rings: requests and responses are
+ * \ref shdev_message_t, response being request with status set.
+ */
+PNR_RING_GENERATE_BI(shdev_message_t, shdev_message_t, shdev_op_ring);
+
+#if defined(__clang__)
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wgnu-variable-sized-type-not-at-end"
+#endif
+
+/** Static definition of a device operation ring */
+typedef struct shdev_op_ring {
+    /* Shared part of the ring */
+    shdev_op_ring_shared_t shared;
+    /* Ring's slot padding. Not used directly, just here to allocate enough
+     * space for SHDEV_OP_RING_SLOTS elements in shared.array */
+    shdev_op_ring_msg_t padding[SHDEV_OP_RING_SLOTS];
+} shdev_op_ring_t;
+
+#if defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
 /** Shared device descriptor */
 typedef struct shdev_desc {
     /* Device identifier */
@@ -185,6 +301,17 @@ typedef struct shdev_desc {
  * data can be handled as \ref shdev_infos_t
  */
 #define SHDEV_MAGIC_INFOS   UINT32_C(0xabeef001)
+
+/** User partition and RPMB operations can be sent without suspending MMC:
+ * Linux driver serializes hardware partition switches.
+ */
+#define SHDEV_MMC_FEATURE_PART_SHARING  UINT32_C(0x1)
+
+/** RPMB read and write requests can carry several data frames, see
+ * shdev_mmc_entry_t.rpmb_frames
+ */
+#define SHDEV_MMC_FEATURE_RPMB_FRAMES   UINT32_C(0x2)
+
 typedef struct shdev_infos {
     /* Magic */
     uint32_t magic;
@@ -194,6 +321,16 @@ typedef struct shdev_infos {
      * work only with shdev_message_t informations.
      */
     shdev_desc_t descriptors[NUM_DEVICES];
+    /* Offset of MMC I/O rings (see \ref shdev_mmc_rings_t), 0 if not
+     * supported. Rings use MMC descriptor's data buffer.
+     */
+    uint32_t mmc_rings_offset;
+    /* Offset of operation rings, one \ref shdev_op_ring_t per device in
+     * descriptors order, 0 if not supported.
+     */
+    uint32_t op_rings_offset;
+    /* MMC features supported by NS, see SHDEV_MMC_FEATURE_xxx */
+    uint32_t mmc_features;
 } shdev_infos_t;
 
 #endif /* _SHDEV_H_INCLUDED_ */
@@ -64,12 +64,43 @@ int pnc_session_get_version(pnc_session_t *session, uint32_t *version);
  *                          called for \p session
  *                      - -EINVAL if \p size is 0
  *                      - -ENOMEM if \p size bytes could not be allocated
- *                      - -ERESTARTSYS if system signal while trying to down
- *                        shm allocator's semaphore.
  *                      - 0 on success
  */
 int pnc_session_alloc(pnc_session_t *session, unsigned long size);
 
+/**
+ * @brief Allocate a small zeroed SHM object for the selected session.
+ *
+ * Unlike \ref pnc_session_alloc, memory is not rounded up to whole pages:
+ * objects of similar size share SHM pages. Objects can be allocated whether or
+ * not session has a memory range and are released when session is closed.
+ * Object is located by its byte offset from SHM base, as known by secure world,
+ * to be forwarded to it through the session's own protocol.
+ *
+ * @param session       Pointer to the session handle
+ * @param size          Requested size in bytes, at most half a page
+ * @param offset        Updated with object's byte offset in SHM
+ * @param ptr           Updated with object's virtual address, if not NULL
+ * @return              - -EINVAL if invalid session handle or \p size
+ *                      - -ENOSPC if too many objects for this session
+ *                      - -ENOMEM if object could not be allocated
+ *                      - -ERESTARTSYS if system error
+ *                      - 0 on success
+ */
+int pnc_session_alloc_obj(pnc_session_t *session, size_t size,
+    unsigned long *offset, void **ptr);
+
+/**
+ * @brief Release a SHM object allocated for the selected session.
+ *
+ * @param session       Pointer to the session handle
+ * @param offset        Object's byte offset in SHM
+ * @return              - -EINVAL if invalid session handle or \p offset
+ *                      - -ERESTARTSYS if system error
+ *                      - 0 on success
+ */
+int pnc_session_free_obj(pnc_session_t *session, unsigned long offset);
+
 /**
  * @brief Configure the selected session with the identifier of the provencore
  *  application.
@@ -109,6 +140,55 @@ int pnc_session_config_by_name(pnc_session_t *session, const char *name);
  */
 int pnc_session_config(pnc_session_t *session, uint64_t sid);
 
+/**
+ * @brief Lease a session configured for the given service identifier
+ *
+ * Reuse an idle session from the session pool, already configured for \p sid
+ * with \p size bytes of memory, if any. Otherwise open, allocate and configure
+ * a new session, as \ref pnc_session_open, \ref pnc_session_alloc and
+ * \ref pnc_session_config would do.
+ *
+ * Leased session is used as any other session, and shall be released with
+ * \ref pnc_session_pool_return.
+ *
+ * @param sid           Service identifier
+ * @param size          Requested memory size in bytes, 0 if none
+ * @param session       Updated with leased session handle
+ * @return              - -EBADF if \p session is NULL
+ *                      - any \ref pnc_session_open, \ref pnc_session_alloc
+ *                        or \ref pnc_session_config error
+ *                      - 0 on success
+ */
+int pnc_session_pool_lease(uint64_t sid, unsigned long size,
+    pnc_session_t **session);
+
+/**
+ * @brief Lease a session configured for the given service name
+ *
+ * Same as \ref pnc_session_pool_lease, with a configuration by name as done by
+ * \ref pnc_session_config_by_name.
+ *
+ * @param name          Name of the ProvenCore service or process to connect to
+ * @param size          Requested memory size in bytes, 0 if none
+ * @param session       Updated with leased session handle
+ * @return              - -EINVAL if \p name is NULL
+ *                      - same as \ref pnc_session_pool_lease otherwise
+ */
+int pnc_session_pool_lease_by_name(const char *name, unsigned long size,
+    pnc_session_t **session);
+
+/**
+ * @brief Return a leased session to the session pool
+ *
+ * If session is still configured with no request in progress, it is reset
+ * (pending events and signals, eventfds, memory content) and kept idle in the
+ * pool for a next lease. Otherwise, or if session was not leased from the pool,
+ * it is closed as with \ref pnc_session_close.
+ *
+ * @param session       Pointer to the session handle
+ */
+void pnc_session_pool_return(pnc_session_t *session);
+
 /**
  * @brief Retrieve SHM information for the selected session.
  *
@@ -122,6 +202,76 @@ int pnc_session_config(pnc_session_t *session, uint64_t sid);
  */
 int pnc_session_get_mem(pnc_session_t *session, char **ptr, unsigned long *size);
 
+/**
+ * @brief Attach an additional SHM region to the selected session.
+ *
+ * Unlike memory allocated with \ref pnc_session_alloc (region 0), which is
+ * given to S once at configuration time, regions can be attached, resized and
+ * detached at any time once session is configured. Each change is forwarded to
+ * S, and acknowledged by it, before returning.
+ *
+ * @param session       Pointer to the session handle
+ * @param size          Requested size in bytes
+ * @param id            Updated with region id, as known by S
+ * @return              - -EINVAL if invalid parameters
+ *                      - -ENOSPC if no more region available for this session
+ *                      - -ENOMEM if \p size bytes could not be allocated
+ *                      - -ENOTSUPP if REE version is not supporting the feature
+ *                      - -ENODEV if session not configured
+ *                      - -ETIMEDOUT if no acknowledge in time: region is
+ *                        attached anyway, to be detached later
+ *                      - -EPIPE if session terminated while waiting
+ *                      - -ERESTARTSYS if system error
+ *                      - 0 on success
+ *                      - strictly positive value to report S error...
+ *
+ * Note: Available since REEV3.04.
+ */
+int pnc_session_attach_region(pnc_session_t *session, unsigned long size,
+    unsigned int *id);
+
+/**
+ * @brief Resize a SHM region of the selected session.
+ *
+ * Region is resized in place when possible. Otherwise its content is moved to
+ * a new SHM range, and any previous address of the region becomes invalid.
+ * Region keeps its former geometry on failure.
+ *
+ * @param session       Pointer to the session handle
+ * @param id            Region id
+ * @param size          Requested new size in bytes
+ * @return              - -ENOENT if region not attached
+ *                      - same as \ref pnc_session_attach_region otherwise
+ */
+int pnc_session_resize_region(pnc_session_t *session, unsigned int id,
+    unsigned long size);
+
+/**
+ * @brief Detach a SHM region from the selected session.
+ *
+ * @param session       Pointer to the session handle
+ * @param id            Region id
+ * @return              - -ENOENT if region not attached
+ *                      - same as \ref pnc_session_attach_region otherwise
+ */
+int pnc_session_detach_region(pnc_session_t *session, unsigned int id);
+
+/**
+ * @brief Retrieve SHM information for a region of the selected session.
+ *
+ * @param session       Pointer to the session handle
+ * @param id            Region id, 0 for memory allocated with
+ *                      \ref pnc_session_alloc
+ * @param ptr           Updated with the virtual address of the region
+ * @param size          Updated with the size in bytes of the region
+ * @return              - -EINVAL if \p session is NULL or invalid \p id
+ *                      - -ENOMEM if the region is not allocated.
+ *                      - -ENODEV if whole SHM not allocated.
+ *                      - 0 on success
+ */
+int pnc_session_get_region(pnc_session_t *session, unsigned int id, char **ptr,
+    unsigned long *size);
+
 /**
  * @brief Send response to a previous request.
  *
@@ -197,6 +347,64 @@ int pnc_session_wait_response(pnc_session_t *session, uint32_t *response,
  */
 int pnc_session_send_request(pnc_session_t *session, uint32_t request);
 
+/**
+ * @brief Completion callback of an asynchronous request
+ *
+ * Called from REE notification work, or from \ref pnc_session_close, without
+ * any session lock held: callback can send a new request on the same session
+ * but shall not sleep for long since it delays all other sessions' events.
+ *
+ * @param session       Pointer to the session handle
+ * @param status        - 0 if \p response received
+ *                      - -ECANCELED if request cancelled
+ *                      - -EPIPE if session terminated before response
+ * @param response      Response to request, if \p status is 0
+ * @param ctx           Context given when sending request
+ */
+typedef void (*pnc_session_response_cb_t)(pnc_session_t *session, int status,
+    uint32_t response, void *ctx);
+
+/**
+ * @brief Send a request through the selected session, with response reported
+ *  to a completion callback.
+ *
+ * Don't wait for response: \p cb is called once, on response reception or
+ * request cancellation or session termination. Response is not reported
+ * through any event (and can't be fetched with \ref pnc_session_get_response)
+ * and client is ready to send a new request when \p cb is called.
+ *
+ * @param session       Pointer to the session handle
+ * @param request       Request to send
+ * @param cb            Completion callback
+ * @param ctx           Context given back to \p cb
+ * @return              - -ENOENT if SHM is not ready
+ *                      - -EINVAL if invalid session handle or \p cb is NULL
+ *                      - -ERESTARTSYS if system error
+ *                      - -ENODEV if session not configured
+ *                      - -EPROTO if client not ready to send request
+ *                      - 0 on success
+ */
+int pnc_session_send_request_async(pnc_session_t *session, uint32_t request,
+    pnc_session_response_cb_t cb, void *ctx);
+
+/**
+ * @brief Request cancellation of pending asynchronous request
+ *
+ * Don't wait for acknowledge: request's callback is called with -ECANCELED
+ * status once S acknowledges cancellation, or with the response if it was
+ * already sent.
+ *
+ * @param session       Pointer to the session handle
+ * @return              - -ENOENT if SHM is not ready
+ *                      - -EINVAL if invalid session handle
+ *                      - -ERESTARTSYS if system error
+ *                      - -ENODEV if session not configured
+ *                      - -EPROTO if no asynchronous request pending
+ *                      - -EALREADY if cancellation already requested
+ *                      - 0 on success
+ */
+int pnc_session_cancel_request_async(pnc_session_t *session);
+
 /**
  * @brief Fetch available request for a given session
  *
@@ -263,7 +471,8 @@ int pnc_session_wait_request(pnc_session_t *session, uint32_t *request,
  *                      - -EINVAL if invalid session handle
  *                      - -ERESTARTSYS if system error
  *                      - -ENODEV if session not configured
- *                      - -EPROTO if client not ready to cancel request
+ *                      - -EPROTO if client not ready to cancel request, or if
+ *                        request was sent asynchronously
  *                      - -ETIMEDOUT if no acknowledge in time
  *                      - -EPIPE if session terminated while waiting
  *                      - REQUEST_CANCEL_xxx status on success (see above)
@@ -364,6 +573,43 @@ int pnc_session_get_signal(pnc_session_t *session, uint32_t *signals);
 int pnc_session_wait_signal(pnc_session_t *session, uint32_t *signals,
     uint32_t timeout);
 
+/**
+ * @brief Handler of S signals
+ *
+ * Called from REE notification work, without any session lock held. Shall not
+ * sleep for long since it delays all other sessions' events: typically
+ * schedules some work.
+ *
+ * @param session       Pointer to the session handle
+ * @param signals       Received signal bits, already acknowledged
+ * @param ctx           Context given when registering handler
+ */
+typedef void (*pnc_session_signal_cb_t)(pnc_session_t *session,
+    uint32_t signals, void *ctx);
+
+/**
+ * @brief Register a handler for some S signal bits
+ *
+ * Signal bits in \p mask are acknowledged and given to \p fn as soon as they
+ * are received, including those already received but not acknowledged yet.
+ * They are not reported anymore through EVENT_PENDING_SIGNAL event nor
+ * \ref pnc_session_get_signal. Other bits are kept pending as usual.
+ *
+ * Registering replaces any previous handler. Handler is unregistered when
+ * session is closed. Once unregistered, handler may still be running for bits
+ * received just before.
+ *
+ * @param session       Pointer to the session handle
+ * @param mask          Signal bits to handle
+ * @param fn            Handler, NULL to unregister
+ * @param ctx           Context given back to \p fn
+ * @return              - -EINVAL if invalid session handle or \p mask is 0
+ *                      - -ERESTARTSYS if system error
+ *                      - 0 on success
+ */
+int pnc_session_register_signal_handler(pnc_session_t *session, uint32_t mask,
+    pnc_session_signal_cb_t fn, void *ctx);
+
 /**
  * Bits that can be used to build mask when calling \ref pnc_session_wait_event
  */
@@ -373,6 +619,12 @@ int pnc_session_wait_signal(pnc_session_t *session, uint32_t *signals,
 #define EVENT_PENDING_ALL       (EVENT_PENDING_SIGNAL  | \
                                  EVENT_PENDING_REQUEST | \
                                  EVENT_PENDING_RESPONSE)
+/**
+ * Modifier bit that can be or'ed to the mask when calling
+ * \ref pnc_session_wait_event: among all the exclusive waiters of a session,
+ * only one is woken up for a given event instead of all of them.
+ */
+#define EVENT_WAIT_EXCLUSIVE    (UINT32_C(1) << 31)
 
 /**
  * @brief Wait for any S event
@@ -385,6 +637,11 @@ int pnc_session_wait_signal(pnc_session_t *session, uint32_t *signals,
  *  - EVENT_PENDING_RESPONSE: function returns if S response received
  *  - EVENT_PENDING_ALL: function returns if any of S event received
  *
+ * Only the waiters whose mask matches a received event are woken up. Adding
+ * EVENT_WAIT_EXCLUSIVE to \p mask makes the caller an exclusive waiter: this is
+ * meant for several threads serving the same session, so that a single one of
+ * them is woken up per event.
+ *
  * When returning successfully, \p events bits are set to indicate which kind of
  * event was received and the corresponding \ref pnc_session_get_response,
  * \ref pnc_session_get_request and \ref pnc_session_get_signal functions can be